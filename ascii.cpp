@@ -12,6 +12,13 @@ static inline int ascii_std(const uint8_t *data, int len)
     return !std::any_of(data, data+len, [] (int8_t b) { return b < 0; });
 }
 
+/* Find first non-ascii byte, return its offset or len if all ascii */
+static inline int ascii_std_find(const uint8_t *data, int len)
+{
+    return std::find_if(data, data+len, [] (int8_t b) { return b < 0; })
+        - data;
+}
+
 static inline int ascii_u64(const uint8_t *data, int len)
 {
     uint8_t orall = 0;
@@ -43,6 +50,28 @@ static inline int ascii_u64(const uint8_t *data, int len)
     return orall < 0x80;
 }
 
+static inline int ascii_u64_find(const uint8_t *data, int len)
+{
+    const uint8_t *start = data;
+
+    while (len >= 8) {
+        const uint64_t m = *(const uint64_t *)data & 0x8080808080808080ULL;
+        /* Little endian: lowest set bit is in first non-ascii byte */
+        if (m)
+            return data - start + __builtin_ctzll(m) / 8;
+        data += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        if (*data >= 0x80)
+            break;
+        ++data;
+    }
+
+    return data - start;
+}
+
 #if defined(__x86_64__)
 #include <x86intrin.h>
 
@@ -73,6 +102,132 @@ static inline int ascii_simd(const uint8_t *data, int len)
     return ascii_u64(data, len);
 }
 
+static inline int ascii_simd_find(const uint8_t *data, int len)
+{
+    const uint8_t *start = data;
+
+    while (len >= 32) {
+        __m128i input1 = _mm_loadu_si128((const __m128i *)data);
+        __m128i input2 = _mm_loadu_si128((const __m128i *)(data+16));
+
+        if (_mm_movemask_epi8(_mm_or_si128(input1, input2))) {
+            const uint32_t m = _mm_movemask_epi8(input1) |
+                               (_mm_movemask_epi8(input2) << 16);
+            return data - start + __builtin_ctz(m);
+        }
+
+        data += 32;
+        len -= 32;
+    }
+
+    return data - start + ascii_u64_find(data, len);
+}
+
+#ifdef __AVX2__
+static inline int ascii_avx2(const uint8_t *data, int len)
+{
+    if (len >= 128) {
+        __m256i or1 = _mm256_set1_epi8(0), or2 = or1, or3 = or1, or4 = or1;
+
+        while (len >= 128) {
+            or1 = _mm256_or_si256(or1,
+                    _mm256_loadu_si256((const __m256i *)data));
+            or2 = _mm256_or_si256(or2,
+                    _mm256_loadu_si256((const __m256i *)(data+32)));
+            or3 = _mm256_or_si256(or3,
+                    _mm256_loadu_si256((const __m256i *)(data+64)));
+            or4 = _mm256_or_si256(or4,
+                    _mm256_loadu_si256((const __m256i *)(data+96)));
+
+            data += 128;
+            len -= 128;
+        }
+
+        or1 = _mm256_or_si256(_mm256_or_si256(or1, or2),
+                              _mm256_or_si256(or3, or4));
+        if (_mm256_movemask_epi8(or1))
+            return 0;
+    }
+
+    return ascii_simd(data, len);
+}
+
+static inline int ascii_avx2_find(const uint8_t *data, int len)
+{
+    const uint8_t *start = data;
+
+    while (len >= 128) {
+        __m256i input1 = _mm256_loadu_si256((const __m256i *)data);
+        __m256i input2 = _mm256_loadu_si256((const __m256i *)(data+32));
+        __m256i input3 = _mm256_loadu_si256((const __m256i *)(data+64));
+        __m256i input4 = _mm256_loadu_si256((const __m256i *)(data+96));
+
+        __m256i or1 = _mm256_or_si256(_mm256_or_si256(input1, input2),
+                                      _mm256_or_si256(input3, input4));
+        if (_mm256_movemask_epi8(or1)) {
+            /* Rare path, locate the byte in four 32 bits masks */
+            const uint64_t m12 = (uint32_t)_mm256_movemask_epi8(input1) |
+                ((uint64_t)(uint32_t)_mm256_movemask_epi8(input2) << 32);
+            if (m12)
+                return data - start + __builtin_ctzll(m12);
+            const uint64_t m34 = (uint32_t)_mm256_movemask_epi8(input3) |
+                ((uint64_t)(uint32_t)_mm256_movemask_epi8(input4) << 32);
+            return data - start + 64 + __builtin_ctzll(m34);
+        }
+
+        data += 128;
+        len -= 128;
+    }
+
+    return data - start + ascii_simd_find(data, len);
+}
+#endif
+
+#ifdef __AVX512BW__
+/* vpmovb2m: bit i of mask is 7-th bit of byte i */
+static inline int ascii_avx512(const uint8_t *data, int len)
+{
+    __m512i or1 = _mm512_setzero_si512(), or2 = or1;
+
+    while (len >= 128) {
+        or1 = _mm512_or_si512(or1, _mm512_loadu_si512(data));
+        or2 = _mm512_or_si512(or2, _mm512_loadu_si512(data+64));
+        data += 128;
+        len -= 128;
+    }
+
+    if (len >= 64) {
+        or1 = _mm512_or_si512(or1, _mm512_loadu_si512(data));
+        data += 64;
+        len -= 64;
+    }
+
+    /* Masked load of remaining bytes, masked out bytes never fault */
+    const __mmask64 tail = len ? ~0ULL >> (64 - len) : 0;
+    or2 = _mm512_or_si512(or2, _mm512_maskz_loadu_epi8(tail, data));
+
+    return _mm512_movepi8_mask(_mm512_or_si512(or1, or2)) == 0;
+}
+
+static inline int ascii_avx512_find(const uint8_t *data, int len)
+{
+    const uint8_t *start = data;
+
+    while (len >= 64) {
+        const uint64_t m = _mm512_movepi8_mask(_mm512_loadu_si512(data));
+        if (m)
+            return data - start + __builtin_ctzll(m);
+        data += 64;
+        len -= 64;
+    }
+
+    const __mmask64 tail = len ? ~0ULL >> (64 - len) : 0;
+    const uint64_t m =
+        _mm512_movepi8_mask(_mm512_maskz_loadu_epi8(tail, data));
+    return data - start + (m ? __builtin_ctzll(m) : len);
+}
+#endif
+
 #elif defined(__aarch64__)
 #include <arm_neon.h>
 
@@ -103,24 +258,65 @@ static inline int ascii_simd(const uint8_t *data, int len)
     return ascii_u64(data, len);
 }
 
+static inline int ascii_simd_find(const uint8_t *data, int len)
+{
+    const uint8_t *start = data;
+
+    while (len >= 32) {
+        const uint8x16_t input1 = vld1q_u8(data);
+        const uint8x16_t input2 = vld1q_u8(data+16);
+
+        /* No movemask on NEON, locate the byte in 32 bytes with u64 */
+        if (vmaxvq_u8(vorrq_u8(input1, input2)) >= 0x80)
+            return data - start + ascii_u64_find(data, 32);
+
+        data += 32;
+        len -= 32;
+    }
+
+    return data - start + ascii_u64_find(data, len);
+}
+
 #endif
 
+/*
+ * func: return 1 if all bytes are ascii, 0 otherwise
+ * find: return offset of first non-ascii byte, len if all ascii
+ */
 struct ftab {
     const char *name;
     int (*func)(const uint8_t *data, int len);
+    int (*find)(const uint8_t *data, int len);
 };
 
 static const std::vector<ftab> _f = {
     {
         .name = "std",
         .func = ascii_std,
+        .find = ascii_std_find,
     }, {
         .name = "u64",
         .func = ascii_u64,
+        .find = ascii_u64_find,
     }, {
         .name = "simd",
         .func = ascii_simd,
+        .find = ascii_simd_find,
+    },
+#ifdef __AVX2__
+    {
+        .name = "avx2",
+        .func = ascii_avx2,
+        .find = ascii_avx2_find,
     },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "avx512",
+        .func = ascii_avx512,
+        .find = ascii_avx512_find,
+    },
+#endif
 };
 
 static void load_test_buf(uint8_t *data, int len)
@@ -133,35 +329,45 @@ static void load_test_buf(uint8_t *data, int len)
     }
 }
 
+/* Time func, or find which must return len as data is all ascii */
+static double bench_one(const struct ftab &f, bool find,
+                        const uint8_t *data, int len, int loops, int *ret)
+{
+    struct timeval tv1, tv2;
+    double time;
+
+    gettimeofday(&tv1, 0);
+    if (find) {
+        for (int i = 0; i < loops; ++i)
+            *ret &= (f.find(data, len) == len);
+    } else {
+        for (int i = 0; i < loops; ++i)
+            *ret &= f.func(data, len);
+    }
+    gettimeofday(&tv2, 0);
+    time = tv2.tv_usec - tv1.tv_usec;
+    return time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+}
+
 static void bench(const struct ftab &f, const uint8_t *data, int len)
 {
     const int loops = 1024*1024*1024/len;
     int ret = 1;
-    double time_aligned, time_unaligned, size;
-    struct timeval tv1, tv2;
+    double time_aligned, time_unaligned, time_find_a, time_find_u, size;
 
     fprintf(stderr, "bench %s (%d bytes)... ", f.name, len);
 
-    /* aligned */
-    gettimeofday(&tv1, 0);
-    for (int i = 0; i < loops; ++i)
-        ret &= f.func(data, len);
-    gettimeofday(&tv2, 0);
-    time_aligned = tv2.tv_usec - tv1.tv_usec;
-    time_aligned = time_aligned / 1000000 + tv2.tv_sec - tv1.tv_sec;
-
-    /* unaligned */
-    gettimeofday(&tv1, 0);
-    for (int i = 0; i < loops; ++i)
-        ret &= f.func(data+1, len);
-    gettimeofday(&tv2, 0);
-    time_unaligned = tv2.tv_usec - tv1.tv_usec;
-    time_unaligned = time_unaligned / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    time_aligned = bench_one(f, false, data, len, loops, &ret);
+    time_unaligned = bench_one(f, false, data+1, len, loops, &ret);
+    time_find_a = bench_one(f, true, data, len, loops, &ret);
+    time_find_u = bench_one(f, true, data+1, len, loops, &ret);
 
     printf("%s ", ret?"pass":"FAIL");
 
     size = ((double)len * loops) / (1024*1024);
-    printf("%.0f/%.0f MB/s\n", size / time_aligned, size / time_unaligned);
+    printf("%.0f/%.0f MB/s, find %.0f/%.0f MB/s\n",
+           size / time_aligned, size / time_unaligned,
+           size / time_find_a, size / time_find_u);
 }
 
 static void test(const struct ftab &f, uint8_t *data, int len)
@@ -172,13 +378,22 @@ static void test(const struct ftab &f, uint8_t *data, int len)
 
     /* positive */
     error |= !f.func(data, len);
+    error |= f.find(data, len) != len;
 
-    /* negative */
+    /* negative, find must also skip non-ascii bytes after first one */
     if (len < 100*1024) {
         for (int i = 0; i < len; ++i) {
             data[i] += 0x80;
             error |= f.func(data, len);
+            error |= f.find(data, len) != i;
             data[i] -= 0x80;
+            if (i < len-1) {
+                data[len-1] += 0x80;
+                data[i] += 0x80;
+                error |= f.find(data, len) != i;
+                data[i] -= 0x80;
+                data[len-1] -= 0x80;
+            }
         }
     }
 
@@ -230,6 +445,6 @@ int main(int argc, const char *argv[])
         }
     }
 
-    delete _data;
+    delete[] _data;
     return 0;
 }
@@ -0,0 +1,434 @@
+/*
+ * Bulk file validation with io_uring, see bulk.h
+ *
+ * liburing is not required, the ring is set up by raw syscalls. Each slot
+ * of the pool runs one file through OPENAT -> STATX, READ(_FIXED) ... ->
+ * CLOSE, user_data of a request is its slot index. STATX is linked ahead of
+ * the first read, a short read of a regular file is its end, other files
+ * are read until a read returns 0. Validation runs on completed reads
+ * between two io_uring_enter() calls, so the kernel keeps reading other
+ * files meanwhile.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "bulk.h"
+#include "utf8range.h"
+
+#define BULK_QD         64              /* Files in flight */
+#define BULK_BUF        (64*1024)       /* Bytes per read */
+#define CLOSE_TAG       (~0ULL)         /* user_data of CLOSE requests */
+#define STATX_TAG       (1ULL << 32)    /* Or'ed to slot index of STATX */
+
+struct ring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail;     /* Queued, not yet published */
+    unsigned to_submit;
+    unsigned inflight;          /* Submitted, not yet completed */
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size;
+};
+
+struct slot {
+    char *path;                 /* NULL if slot is free */
+    int fd;                     /* -1 until opened */
+    long long pos;              /* File offset of next read */
+    long long size;             /* Regular file size, -1 if unknown */
+    struct statx stx;
+    struct utf8_stream stream;
+    unsigned char *buf;
+};
+
+static int ring_init(struct ring *r, unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return -1;
+
+    r->entries = p.sq_entries;
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size)
+            r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+
+    r->sq_ptr = mmap(0, r->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        goto err_close;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(0, r->cq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            goto err_sq;
+    }
+    r->sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto err_cq;
+
+    r->sq_head = (unsigned *)((char *)r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+    r->sq_local_tail = *r->sq_tail;
+    r->to_submit = 0;
+    r->inflight = 0;
+
+    return 0;
+
+err_cq:
+    if (r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+err_sq:
+    munmap(r->sq_ptr, r->sq_size);
+err_close:
+    close(r->fd);
+    return -1;
+}
+
+static void ring_exit(struct ring *r)
+{
+    munmap(r->sqes, r->entries * sizeof(struct io_uring_sqe));
+    if (r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+    munmap(r->sq_ptr, r->sq_size);
+    close(r->fd);
+}
+
+/* Kernel must support all opcodes used */
+static int ring_probe(struct ring *r)
+{
+    static const int ops[] = {
+        IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE,
+    };
+    const size_t size = sizeof(struct io_uring_probe) +
+                        256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int ret = -1;
+
+    if (probe && syscall(__NR_io_uring_register, r->fd,
+                         IORING_REGISTER_PROBE, probe, 256) == 0) {
+        ret = 0;
+        for (int i = 0; i < sizeof(ops)/sizeof(ops[0]); ++i) {
+            if (ops[i] > probe->last_op ||
+                    !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+                ret = -1;
+        }
+    }
+
+    free(probe);
+    return ret;
+}
+
+/*
+ * SQ never overflows, each slot queues at most 2 requests per submit. With
+ * CLOSE of its previous file, a slot has at most 3 requests in flight, CQ
+ * has twice as many entries as SQ.
+ */
+static struct io_uring_sqe *ring_sqe(struct ring *r, int op,
+                                     unsigned long long user_data)
+{
+    const unsigned idx = r->sq_local_tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    ++r->sq_local_tail;
+    ++r->to_submit;
+
+    return sqe;
+}
+
+/* Publish queued requests, wait for at least one completion */
+static int ring_submit_wait(struct ring *r)
+{
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+
+    for (;;) {
+        const int ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit,
+                                1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (ret >= 0) {
+            r->to_submit -= ret;
+            r->inflight += ret;
+            return 0;
+        }
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+static void queue_read(struct ring *r, struct slot *s, int i, int fixed)
+{
+    struct io_uring_sqe *sqe =
+        ring_sqe(r, fixed ? IORING_OP_READ_FIXED : IORING_OP_READ, i);
+
+    sqe->fd = s->fd;
+    sqe->addr = (unsigned long)s->buf;
+    sqe->len = BULK_BUF;
+    sqe->off = s->pos;
+    sqe->buf_index = i;
+}
+
+/* File type and size, read goes on if STATX fails */
+static void queue_statx(struct ring *r, struct slot *s, int i)
+{
+    struct io_uring_sqe *sqe = ring_sqe(r, IORING_OP_STATX, STATX_TAG | i);
+
+    sqe->fd = s->fd;
+    sqe->addr = (unsigned long)"";
+    sqe->statx_flags = AT_EMPTY_PATH;
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = (unsigned long)&s->stx;
+    sqe->flags = IOSQE_IO_HARDLINK;
+}
+
+static void queue_close(struct ring *r, struct slot *s)
+{
+    struct io_uring_sqe *sqe = ring_sqe(r, IORING_OP_CLOSE, CLOSE_TAG);
+
+    sqe->fd = s->fd;
+}
+
+static void slot_done(struct slot *s, long long err, bulk_report_fn report,
+                      void *arg)
+{
+    report(s->path, err, arg);
+    free(s->path);
+    s->path = NULL;
+}
+
+static int bulk_uring(bulk_next_fn next, bulk_report_fn report, void *arg)
+{
+    struct ring r;
+    struct slot slots[BULK_QD];
+    struct iovec iov[BULK_QD];
+    unsigned char *pool;
+    int active = 0, closing = 0, eof = 0, fixed, ret = 0;
+
+    if (ring_init(&r, BULK_QD * 2))
+        return -1;
+    if (ring_probe(&r) ||
+            !(pool = aligned_alloc(4096, (size_t)BULK_QD * BULK_BUF))) {
+        ring_exit(&r);
+        return -1;
+    }
+
+    for (int i = 0; i < BULK_QD; ++i) {
+        slots[i].path = NULL;
+        slots[i].buf = pool + (size_t)i * BULK_BUF;
+        iov[i].iov_base = slots[i].buf;
+        iov[i].iov_len = BULK_BUF;
+    }
+    /* Fixed buffers save page pinning per read, optional */
+    fixed = syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS,
+                    iov, BULK_QD) == 0;
+
+    for (;;) {
+        /* Open next files in free slots */
+        for (int i = 0; i < BULK_QD && !eof; ++i) {
+            if (slots[i].path)
+                continue;
+
+            const char *path = next(arg);
+            if (path == NULL) {
+                eof = 1;
+                break;
+            }
+
+            struct slot *s = &slots[i];
+            struct io_uring_sqe *sqe = ring_sqe(&r, IORING_OP_OPENAT, i);
+
+            s->path = strdup(path);
+            s->fd = -1;
+            s->pos = 0;
+            s->size = -1;
+            utf8_stream_init(&s->stream);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)s->path;
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            ++active;
+        }
+
+        if (active == 0 && closing == 0)
+            break;
+        if (ring_submit_wait(&r)) {
+            ret = -errno;
+            break;
+        }
+
+        /* Reap all completions, validate completed reads */
+        unsigned head = *r.cq_head;
+        const unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+
+        r.inflight -= tail - head;
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+            const int res = cqe->res;
+
+            if (cqe->user_data == CLOSE_TAG) {
+                --closing;
+                continue;
+            }
+
+            /* Completes before the linked first read starts */
+            if (cqe->user_data & STATX_TAG) {
+                struct slot *s = &slots[cqe->user_data & ~STATX_TAG];
+
+                if (res == 0 && S_ISREG(s->stx.stx_mode))
+                    s->size = s->stx.stx_size;
+                continue;
+            }
+
+            const int i = cqe->user_data;
+            struct slot *s = &slots[i];
+
+            if (s->fd < 0) {
+                /* OPENAT */
+                if (res < 0) {
+                    slot_done(s, res, report, arg);
+                    --active;
+                } else {
+                    s->fd = res;
+                    queue_statx(&r, s, i);
+                    queue_read(&r, s, i, fixed);
+                }
+                continue;
+            }
+
+            /*
+             * READ, short or zero is end of regular file. Others may read
+             * short (pipes, devices), zero is end of file.
+             */
+            long long err = res;
+            if (res >= 0) {
+                err = utf8_stream_update(&s->stream, s->buf, res);
+                s->pos += res;
+                if (err == 0 && res > 0 && (s->size < 0 ||
+                        (res == BULK_BUF && s->pos < s->size))) {
+                    queue_read(&r, s, i, fixed);
+                    continue;
+                }
+                err = utf8_stream_finish(&s->stream);
+            }
+            queue_close(&r, s);
+            ++closing;
+            slot_done(s, err, report, arg);
+            --active;
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /* Ring failed, wait for requests still using slot buffers and paths */
+    while (ret && r.inflight) {
+        unsigned head = *r.cq_head;
+        const unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+
+        r.inflight -= tail - head;
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+
+            /* Opened files are closed below */
+            if (cqe->user_data != CLOSE_TAG &&
+                    !(cqe->user_data & STATX_TAG) &&
+                    slots[cqe->user_data].fd < 0 && cqe->res >= 0)
+                slots[cqe->user_data].fd = cqe->res;
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+
+        if (r.inflight && syscall(__NR_io_uring_enter, r.fd, 0, 1,
+                                  IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR)
+            break;
+    }
+
+    /* Report files in flight, caller goes on without ring */
+    for (int i = 0; ret && i < BULK_QD; ++i) {
+        if (slots[i].path) {
+            if (slots[i].fd >= 0)
+                close(slots[i].fd);
+            report(slots[i].path, ret, arg);
+            /* Leaked if the kernel may still read it */
+            if (r.inflight == 0)
+                free(slots[i].path);
+        }
+    }
+
+    ring_exit(&r);
+    /* Never freed under reads in flight */
+    if (r.inflight == 0)
+        free(pool);
+    return ret ? -1 : 0;
+}
+
+static int bulk_sync(bulk_next_fn next, bulk_report_fn report, void *arg)
+{
+    unsigned char *buf = malloc(BULK_BUF);
+    const char *path;
+
+    if (buf == NULL)
+        return -1;
+
+    while ((path = next(arg))) {
+        struct utf8_stream stream;
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        long long err = 0;
+        ssize_t n;
+
+        if (fd < 0) {
+            report(path, -errno, arg);
+            continue;
+        }
+
+        utf8_stream_init(&stream);
+        while ((n = read(fd, buf, BULK_BUF)) > 0) {
+            err = utf8_stream_update(&stream, buf, n);
+            if (err)
+                break;
+        }
+        err = n < 0 ? -errno : utf8_stream_finish(&stream);
+        close(fd);
+        report(path, err, arg);
+    }
+
+    free(buf);
+    return 0;
+}
+
+int bulk_validate(bulk_next_fn next, bulk_report_fn report, void *arg,
+                  unsigned int flags)
+{
+    if (!(flags & BULK_SYNC) && bulk_uring(next, report, arg) == 0)
+        return 0;
+
+    return bulk_sync(next, report, arg);
+}
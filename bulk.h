@@ -0,0 +1,30 @@
+#ifndef BULK_H
+#define BULK_H
+
+/*
+ * Bulk file validation (Linux)
+ *
+ * Opens, reads and closes are submitted through io_uring, up to BULK_QD
+ * files in flight, each reading into its own buffer of a fixed pool. Read
+ * buffers are validated as they complete while later reads are in flight.
+ * Falls back to open/read/close if io_uring (>= 5.6) is not available, or
+ * stops working, for the remaining files.
+ */
+
+/* Returns next path to validate, NULL if no more */
+typedef const char *(*bulk_next_fn)(void *arg);
+
+/*
+ * Called once per file, in completion order
+ * err: 0 - valid, >0 - index(1 based) of first error byte, <0 - -errno
+ */
+typedef void (*bulk_report_fn)(const char *path, long long err, void *arg);
+
+/* Use open/read/close, not io_uring */
+#define BULK_SYNC   0x01
+
+/* Return 0 on success, -1 if out of memory */
+int bulk_validate(bulk_next_fn next, bulk_report_fn report, void *arg,
+                  unsigned int flags);
+
+#endif
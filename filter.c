@@ -0,0 +1,238 @@
+/*
+ * Pass through filter, see filter.h
+ *
+ * A char may span two blocks. Validated bytes are written up to the last
+ * complete char of a block, the incomplete char (utf8_stream carry, at most
+ * 3 bytes) is copied before the data of next block and written with it.
+ *
+ * Pages passed by vmsplice() stay referenced by the pipe until the reader
+ * consumes them, a block is refilled only after next block is vmspliced.
+ * That is safe if a block is bigger than the pipe, so the pipe has already
+ * drained it.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "filter.h"
+#include "utf8range.h"
+
+#define NBUF            3               /* Filling, validating, in pipe */
+#define HEADROOM        4096            /* Carried char goes before data */
+
+struct block {
+    unsigned char *data;
+    long long len;              /* Bytes read, -errno on error */
+};
+
+struct reader {
+    int in;
+    struct block blocks[NBUF];
+    sem_t free, filled;
+};
+
+static void sem_wait_intr(sem_t *sem)
+{
+    while (sem_wait(sem) && errno == EINTR)
+        ;
+}
+
+/* Fill blocks in turn, a short block is end of input */
+static void *reader_main(void *arg)
+{
+    struct reader *r = arg;
+
+    for (int k = 0; ; k = (k + 1) % NBUF) {
+        struct block *b = &r->blocks[k];
+        long long n = 0;
+
+        sem_wait_intr(&r->free);
+        while (n < FILTER_BUF) {
+            const ssize_t ret = read(r->in, b->data + n, FILTER_BUF - n);
+
+            if (ret > 0) {
+                n += ret;
+            } else if (ret == 0) {
+                break;
+            } else if (errno != EINTR) {
+                n = -errno;
+                break;
+            }
+        }
+        b->len = n;
+        sem_post(&r->filled);
+
+        if (n != FILTER_BUF)
+            return NULL;
+    }
+}
+
+static int emit(int out, const unsigned char *p, long long len, int vm)
+{
+    while (len > 0) {
+        struct iovec iov = { (void *)p, len };
+        const ssize_t n = vm ? vmsplice(out, &iov, 1, 0) :
+                               write(out, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int emit_file(int in, long long off, int out, long long len)
+{
+    loff_t pos = off;
+
+    while (len > 0) {
+        const ssize_t n = splice(in, &pos, out, NULL, len, SPLICE_F_MORE);
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return n ? -errno : -EIO;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/* Validate mapped file in blocks, write or splice validated bytes */
+static long long filter_map(int in, int out, const unsigned char *map,
+                            long long start, long long size, int pipe_out)
+{
+    struct utf8_stream s;
+    long long emitted = 0, ret = 0;
+
+    utf8_stream_init(&s);
+    for (long long pos = 0; ret == 0 && pos < size; ) {
+        const int n = size - pos < FILTER_BUF ? size - pos : FILTER_BUF;
+        long long err = utf8_stream_update(&s, map + start + pos, n);
+
+        pos += n;
+        if (err == 0 && pos == size)
+            err = utf8_stream_finish(&s);
+
+        const long long end = err ? err - 1 : s.offset;
+        ret = pipe_out ?
+              emit_file(in, start + emitted, out, end - emitted) :
+              emit(out, map + start + emitted, end - emitted, 0);
+        emitted = end;
+        if (ret == 0)
+            ret = err;
+    }
+
+    return ret;
+}
+
+static long long filter_read(int in, int out, int vm)
+{
+    const size_t stride = HEADROOM + FILTER_BUF;
+    struct reader r = { .in = in };
+    struct utf8_stream s;
+    pthread_t thread;
+    long long emitted = 0, ret = 0;
+    int err;
+
+    /* Not heap, pages may still be in pipe after return */
+    unsigned char *mem = mmap(NULL, NBUF * stride, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return -errno;
+    for (int k = 0; k < NBUF; ++k)
+        r.blocks[k].data = mem + k * stride + HEADROOM;
+
+    sem_init(&r.free, 0, NBUF);
+    sem_init(&r.filled, 0, 0);
+    err = pthread_create(&thread, NULL, reader_main, &r);
+    if (err) {
+        munmap(mem, NBUF * stride);
+        return -err;
+    }
+
+    utf8_stream_init(&s);
+    for (int k = 0, first = 1; ; k = (k + 1) % NBUF, first = 0) {
+        struct block *b = &r.blocks[k];
+
+        sem_wait_intr(&r.filled);
+        if (b->len < 0) {
+            ret = b->len;
+            break;
+        }
+
+        /* Carried char is not written yet, it goes before block data */
+        const int held = s.carry_len;
+        unsigned char *p = b->data - held;
+        memcpy(p, s.carry, held);
+
+        long long e = utf8_stream_update(&s, b->data, b->len);
+        if (e == 0 && b->len < FILTER_BUF)
+            e = utf8_stream_finish(&s);
+
+        const long long end = e ? e - 1 : s.offset;
+        ret = emit(out, p, end - emitted, vm);
+        emitted = end;
+        if (ret == 0)
+            ret = e;
+        if (ret || b->len < FILTER_BUF)
+            break;
+
+        /* Release this block, or previous one which the pipe has drained */
+        if (!vm || !first)
+            sem_post(&r.free);
+    }
+
+    /* Reader may be blocked in read() if we stop early */
+    pthread_cancel(thread);
+    pthread_join(thread, NULL);
+    sem_destroy(&r.free);
+    sem_destroy(&r.filled);
+    munmap(mem, NBUF * stride);
+
+    return ret;
+}
+
+long long filter_fd(int in, int out)
+{
+    struct stat st_in, st_out;
+    int pipe_out = 0;
+
+    if (fstat(out, &st_out) == 0 && S_ISFIFO(st_out.st_mode)) {
+        const int size = fcntl(out, F_GETPIPE_SZ);
+
+        pipe_out = size > 0 && size <= FILTER_BUF / 2;
+    }
+
+    if (fstat(in, &st_in) == 0 && S_ISREG(st_in.st_mode)) {
+        long long start = lseek(in, 0, SEEK_CUR);
+
+        if (start < 0 || start > st_in.st_size)
+            start = 0;
+        if (start == st_in.st_size)
+            return 0;
+
+        const unsigned char *map = mmap(NULL, st_in.st_size, PROT_READ,
+                                        MAP_PRIVATE, in, 0);
+        if (map != MAP_FAILED) {
+            madvise((void *)map, st_in.st_size, MADV_SEQUENTIAL);
+            const long long ret = filter_map(in, out, map, start,
+                    st_in.st_size - start, pipe_out);
+            munmap((void *)map, st_in.st_size);
+            return ret;
+        }
+    }
+
+    return filter_read(in, out, pipe_out);
+}
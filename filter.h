@@ -0,0 +1,22 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+/*
+ * Pass through filter (Linux), copies input to output up to first error
+ *
+ * Input is read in FILTER_BUF blocks by a thread while previous blocks are
+ * validated and written. Output to a pipe is vmspliced from the blocks. A
+ * regular file input is mapped, and spliced if output is a pipe.
+ */
+
+#define FILTER_BUF      (1024*1024)
+
+/*
+ * Returns:
+ *  -  0: all input is valid and written
+ *  - >0: index(1 based) of first error byte, bytes before it are written
+ *  - <0: -errno of a read or write error
+ */
+long long filter_fd(int in, int out);
+
+#endif
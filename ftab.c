@@ -0,0 +1,501 @@
+#include "ftab.h"
+#include "utf8range.h"
+
+int utf8_naive(const unsigned char *data, int len);
+int utf8_swar(const unsigned char *data, int len);
+int utf8_lookup(const unsigned char *data, int len);
+int utf8_lookup_stripe(const unsigned char *data, int len);
+int utf8_boost(const unsigned char *data, int len);
+int utf8_lemire(const unsigned char *data, int len);
+int utf8_range(const unsigned char *data, int len);
+int utf8_range2(const unsigned char *data, int len);
+int utf8_range2_nt(const unsigned char *data, int len);
+int utf8_naive_count(const unsigned char *data, int len, size_t *count);
+int utf8_range_count(const unsigned char *data, int len, size_t *count);
+int utf8_naive_index(const unsigned char *data, int len, int *index,
+                     size_t *count);
+int utf8_naive_index_offset(const unsigned char *data, int len,
+                            const int *index, size_t count, size_t k);
+int utf8_range_index(const unsigned char *data, int len, int *index,
+                     size_t *count);
+int utf8_range_index_offset(const unsigned char *data, int len,
+                            const int *index, size_t count, size_t k);
+int utf8_naive_skip_chars(const unsigned char *data, int len, size_t k);
+int utf8_range_skip_chars(const unsigned char *data, int len, size_t k);
+int utf8_json_naive(const unsigned char *data, int len, uint64_t *mask,
+                    size_t *escapes);
+int utf8_range_json(const unsigned char *data, int len, uint64_t *mask,
+                    size_t *escapes);
+int utf8_lines_naive(const unsigned char *data, int len, const char *delims,
+                     int *ends, int *errors, int max_lines);
+int utf8_range_lines(const unsigned char *data, int len, const char *delims,
+                     int *ends, int *errors, int max_lines);
+int utf8_range_cstr(const char *str, size_t *len);
+int utf8_policy_naive(const unsigned char *data, int len, unsigned int policy);
+int utf8_range_policy(const unsigned char *data, int len, unsigned int policy);
+int utf8_cesu8_naive(const unsigned char *data, int len);
+int utf8_mutf8_naive(const unsigned char *data, int len);
+int utf8_range_cesu8(const unsigned char *data, int len);
+int utf8_range_mutf8(const unsigned char *data, int len);
+int utf8_wtf8_naive(const unsigned char *data, int len);
+int utf8_range_wtf8(const unsigned char *data, int len);
+int utf8_mutf8_to_utf8_naive(const unsigned char *src, size_t len,
+                             unsigned char *dst, size_t *dst_len);
+int utf8_range_mutf8_to_utf8(const unsigned char *src, size_t len,
+                             unsigned char *dst, size_t *dst_len);
+#ifdef __x86_64__
+int utf8_lookup3(const unsigned char *data, int len);
+#endif
+#ifdef __AVX2__
+int utf8_lemire_avx2(const unsigned char *data, int len);
+int utf8_lookup3_avx2(const unsigned char *data, int len);
+int utf8_range_avx2(const unsigned char *data, int len);
+int utf8_range_avx2_nt(const unsigned char *data, int len);
+int utf8_range2_avx2(const unsigned char *data, int len);
+int utf8_range_count_avx2(const unsigned char *data, int len, size_t *count);
+int utf8_range_index_avx2(const unsigned char *data, int len, int *index,
+                          size_t *count);
+int utf8_range_index_offset_avx2(const unsigned char *data, int len,
+                                 const int *index, size_t count, size_t k);
+int utf8_range_skip_chars_avx2(const unsigned char *data, int len, size_t k);
+int utf8_range_json_avx2(const unsigned char *data, int len, uint64_t *mask,
+                         size_t *escapes);
+int utf8_range_lines_avx2(const unsigned char *data, int len,
+                          const char *delims, int *ends, int *errors,
+                          int max_lines);
+int utf8_range_cstr_avx2(const char *str, size_t *len);
+int utf8_range_policy_avx2(const unsigned char *data, int len,
+                           unsigned int policy);
+int utf8_range_cesu8_avx2(const unsigned char *data, int len);
+int utf8_range_mutf8_avx2(const unsigned char *data, int len);
+int utf8_range_wtf8_avx2(const unsigned char *data, int len);
+int utf8_range_mutf8_to_utf8_avx2(const unsigned char *src, size_t len,
+                                  unsigned char *dst, size_t *dst_len);
+#endif
+#ifdef __AVX512BW__
+int utf8_range_avx512(const unsigned char *data, int len);
+int utf8_range2_avx512(const unsigned char *data, int len);
+int utf8_range_count_avx512(const unsigned char *data, int len,
+                            size_t *count);
+int utf8_range_index_avx512(const unsigned char *data, int len, int *index,
+                            size_t *count);
+int utf8_range_index_offset_avx512(const unsigned char *data, int len,
+                                   const int *index, size_t count, size_t k);
+int utf8_range_skip_chars_avx512(const unsigned char *data, int len,
+                                 size_t k);
+int utf8_range_json_avx512(const unsigned char *data, int len,
+                           uint64_t *mask, size_t *escapes);
+int utf8_range_lines_avx512(const unsigned char *data, int len,
+                            const char *delims, int *ends, int *errors,
+                            int max_lines);
+int utf8_range_cstr_avx512(const char *str, size_t *len);
+int utf8_range_policy_avx512(const unsigned char *data, int len,
+                             unsigned int policy);
+int utf8_range_cesu8_avx512(const unsigned char *data, int len);
+int utf8_range_mutf8_avx512(const unsigned char *data, int len);
+int utf8_range_wtf8_avx512(const unsigned char *data, int len);
+int utf8_range_mutf8_to_utf8_avx512(const unsigned char *src, size_t len,
+                                    unsigned char *dst, size_t *dst_len);
+#endif
+
+const struct ftab ftab[] = {
+    {
+        .name = "naive",
+        .func = utf8_naive,
+    },
+    {
+        .name = "swar",
+        .func = utf8_swar,
+    },
+    {
+        .name = "lookup",
+        .func = utf8_lookup,
+    },
+    {
+        .name = "lookup_stripe",
+        .func = utf8_lookup_stripe,
+    },
+    {
+        .name = "lemire",
+        .func = utf8_lemire,
+    },
+    {
+        .name = "range",
+        .func = utf8_range,
+    },
+    {
+        .name = "range2",
+        .func = utf8_range2,
+    },
+    {
+        .name = "range2_nt",
+        .func = utf8_range2_nt,
+    },
+#ifdef __x86_64__
+    {
+        .name = "lookup3",
+        .func = utf8_lookup3,
+    },
+#endif
+#ifdef __AVX2__
+    {
+        .name = "lemire_avx2",
+        .func = utf8_lemire_avx2,
+    },
+    {
+        .name = "lookup3_avx2",
+        .func = utf8_lookup3_avx2,
+    },
+    {
+        .name = "range_avx2",
+        .func = utf8_range_avx2,
+    },
+    {
+        .name = "range_avx2_nt",
+        .func = utf8_range_avx2_nt,
+    },
+    {
+        .name = "range2_avx2",
+        .func = utf8_range2_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_avx512",
+        .func = utf8_range_avx512,
+    },
+    {
+        .name = "range2_avx512",
+        .func = utf8_range2_avx512,
+    },
+#endif
+    {
+        .name = "utf8range",
+        .func = utf8_validate,
+    },
+#ifdef BOOST
+    {
+        .name = "boost",
+        .func = utf8_boost,
+    },
+#endif
+};
+
+const int ftab_size = sizeof(ftab)/sizeof(ftab[0]);
+
+const struct ftab_count ftab_count[] = {
+    {
+        .name = "naive_count",
+        .func = utf8_naive_count,
+    },
+    {
+        .name = "range_count",
+        .func = utf8_range_count,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_count_avx2",
+        .func = utf8_range_count_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_count_avx512",
+        .func = utf8_range_count_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_count",
+        .func = utf8_validate_count,
+    },
+};
+
+const int ftab_count_size = sizeof(ftab_count)/sizeof(ftab_count[0]);
+
+const struct ftab_index ftab_index[] = {
+    {
+        .name = "naive_index",
+        .build = utf8_naive_index,
+        .offset = utf8_naive_index_offset,
+    },
+    {
+        .name = "range_index",
+        .build = utf8_range_index,
+        .offset = utf8_range_index_offset,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_index_avx2",
+        .build = utf8_range_index_avx2,
+        .offset = utf8_range_index_offset_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_index_avx512",
+        .build = utf8_range_index_avx512,
+        .offset = utf8_range_index_offset_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_index",
+        .build = utf8_validate_index,
+        .offset = utf8_index_offset,
+    },
+};
+
+const int ftab_index_size = sizeof(ftab_index)/sizeof(ftab_index[0]);
+
+const struct ftab_skip ftab_skip[] = {
+    {
+        .name = "naive_skip",
+        .func = utf8_naive_skip_chars,
+    },
+    {
+        .name = "range_skip",
+        .func = utf8_range_skip_chars,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_skip_avx2",
+        .func = utf8_range_skip_chars_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_skip_avx512",
+        .func = utf8_range_skip_chars_avx512,
+    },
+#endif
+};
+
+const int ftab_skip_size = sizeof(ftab_skip)/sizeof(ftab_skip[0]);
+
+const struct ftab_json ftab_json[] = {
+    {
+        .name = "naive_json",
+        .func = utf8_json_naive,
+    },
+    {
+        .name = "range_json",
+        .func = utf8_range_json,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_json_avx2",
+        .func = utf8_range_json_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_json_avx512",
+        .func = utf8_range_json_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_json",
+        .func = utf8_validate_json,
+    },
+};
+
+const int ftab_json_size = sizeof(ftab_json)/sizeof(ftab_json[0]);
+
+const struct ftab_lines ftab_lines[] = {
+    {
+        .name = "naive_lines",
+        .func = utf8_lines_naive,
+    },
+    {
+        .name = "range_lines",
+        .func = utf8_range_lines,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_lines_avx2",
+        .func = utf8_range_lines_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_lines_avx512",
+        .func = utf8_range_lines_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_lines",
+        .func = utf8_validate_lines,
+    },
+};
+
+const int ftab_lines_size = sizeof(ftab_lines)/sizeof(ftab_lines[0]);
+
+const struct ftab_cstr ftab_cstr[] = {
+    {
+        .name = "range_cstr",
+        .func = utf8_range_cstr,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_cstr_avx2",
+        .func = utf8_range_cstr_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_cstr_avx512",
+        .func = utf8_range_cstr_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_cstr",
+        .func = utf8_validate_cstr,
+    },
+};
+
+const int ftab_cstr_size = sizeof(ftab_cstr)/sizeof(ftab_cstr[0]);
+
+const struct ftab_policy ftab_policy[] = {
+    {
+        .name = "policy_naive",
+        .func = utf8_policy_naive,
+    },
+    {
+        .name = "range_policy",
+        .func = utf8_range_policy,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_policy_avx2",
+        .func = utf8_range_policy_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_policy_avx512",
+        .func = utf8_range_policy_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_policy",
+        .func = utf8_validate_policy,
+    },
+};
+
+const int ftab_policy_size = sizeof(ftab_policy)/sizeof(ftab_policy[0]);
+
+const struct ftab ftab_cesu8[] = {
+    {
+        .name = "cesu8_naive",
+        .func = utf8_cesu8_naive,
+    },
+    {
+        .name = "range_cesu8",
+        .func = utf8_range_cesu8,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_cesu8_avx2",
+        .func = utf8_range_cesu8_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_cesu8_avx512",
+        .func = utf8_range_cesu8_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_cesu8",
+        .func = utf8_validate_cesu8,
+    },
+};
+
+const int ftab_cesu8_size = sizeof(ftab_cesu8)/sizeof(ftab_cesu8[0]);
+
+const struct ftab ftab_mutf8[] = {
+    {
+        .name = "mutf8_naive",
+        .func = utf8_mutf8_naive,
+    },
+    {
+        .name = "range_mutf8",
+        .func = utf8_range_mutf8,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_mutf8_avx2",
+        .func = utf8_range_mutf8_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_mutf8_avx512",
+        .func = utf8_range_mutf8_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_mutf8",
+        .func = utf8_validate_mutf8,
+    },
+};
+
+const int ftab_mutf8_size = sizeof(ftab_mutf8)/sizeof(ftab_mutf8[0]);
+
+const struct ftab ftab_wtf8[] = {
+    {
+        .name = "wtf8_naive",
+        .func = utf8_wtf8_naive,
+    },
+    {
+        .name = "range_wtf8",
+        .func = utf8_range_wtf8,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_wtf8_avx2",
+        .func = utf8_range_wtf8_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_wtf8_avx512",
+        .func = utf8_range_wtf8_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_wtf8",
+        .func = utf8_validate_wtf8,
+    },
+};
+
+const int ftab_wtf8_size = sizeof(ftab_wtf8)/sizeof(ftab_wtf8[0]);
+
+const struct ftab_conv ftab_mutf8_conv[] = {
+    {
+        .name = "mutf8_to_utf8_naive",
+        .func = utf8_mutf8_to_utf8_naive,
+    },
+    {
+        .name = "range_mutf8_to_utf8",
+        .func = utf8_range_mutf8_to_utf8,
+    },
+#ifdef __AVX2__
+    {
+        .name = "range_mutf8_to_utf8_avx2",
+        .func = utf8_range_mutf8_to_utf8_avx2,
+    },
+#endif
+#ifdef __AVX512BW__
+    {
+        .name = "range_mutf8_to_utf8_avx512",
+        .func = utf8_range_mutf8_to_utf8_avx512,
+    },
+#endif
+    {
+        .name = "utf8range_from_mutf8",
+        .func = utf8_from_mutf8,
+    },
+};
+
+const int ftab_mutf8_conv_size =
+    sizeof(ftab_mutf8_conv)/sizeof(ftab_mutf8_conv[0]);
@@ -0,0 +1,122 @@
+#ifndef FTAB_H
+#define FTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Table of all UTF-8 validation kernels, shared by the test/benchmark
+ * driver (main.c) and the differential fuzzer (fuzz.c).
+ *
+ * Each kernel returns 0 on success. On error it returns either -1, or the
+ * index(1 based) of first error char if it can tell (see utf8_naive).
+ */
+struct ftab {
+    const char *name;
+    int (*func)(const unsigned char *data, int len);
+};
+
+extern const struct ftab ftab[];
+extern const int ftab_size;
+
+/*
+ * Kernels validating string and counting chars in one pass, count of chars
+ * is returned in *count on success, same return values as above
+ */
+struct ftab_count {
+    const char *name;
+    int (*func)(const unsigned char *data, int len, size_t *count);
+};
+
+extern const struct ftab_count ftab_count[];
+extern const int ftab_count_size;
+
+/*
+ * Kernels validating string and building sparse char index, with lookup of
+ * byte offset of k-th char, see utf8_validate_index()
+ */
+struct ftab_index {
+    const char *name;
+    int (*build)(const unsigned char *data, int len, int *index,
+                 size_t *count);
+    int (*offset)(const unsigned char *data, int len, const int *index,
+                  size_t count, size_t k);
+};
+
+extern const struct ftab_index ftab_index[];
+extern const int ftab_index_size;
+
+/*
+ * Byte offset of k-th char of well-formed string, len if there are exactly
+ * k chars, -1 if less, see utf8_truncate_chars()
+ */
+struct ftab_skip {
+    const char *name;
+    int (*func)(const unsigned char *data, int len, size_t k);
+};
+
+extern const struct ftab_skip ftab_skip[];
+extern const int ftab_skip_size;
+
+/* Kernels validating string and finding JSON escapes, utf8_validate_json() */
+struct ftab_json {
+    const char *name;
+    int (*func)(const unsigned char *data, int len, uint64_t *mask,
+                size_t *escapes);
+};
+
+extern const struct ftab_json ftab_json[];
+extern const int ftab_json_size;
+
+/* Kernels splitting and validating lines, see utf8_validate_lines() */
+struct ftab_lines {
+    const char *name;
+    int (*func)(const unsigned char *data, int len, const char *delims,
+                int *ends, int *errors, int max_lines);
+};
+
+extern const struct ftab_lines ftab_lines[];
+extern const int ftab_lines_size;
+
+/*
+ * Kernels validating NUL terminated string, length of string is returned
+ * in *len, same return values as above
+ */
+struct ftab_cstr {
+    const char *name;
+    int (*func)(const char *str, size_t *len);
+};
+
+extern const struct ftab_cstr ftab_cstr[];
+extern const int ftab_cstr_size;
+
+/* Kernels rejecting code points per policy (UTF8_POLICY_* in utf8range.h) */
+struct ftab_policy {
+    const char *name;
+    int (*func)(const unsigned char *data, int len, unsigned int policy);
+};
+
+extern const struct ftab_policy ftab_policy[];
+extern const int ftab_policy_size;
+
+/* CESU-8 and Modified UTF-8 kernels, same signature as ftab[] */
+extern const struct ftab ftab_cesu8[];
+extern const int ftab_cesu8_size;
+extern const struct ftab ftab_mutf8[];
+extern const int ftab_mutf8_size;
+
+/* WTF-8 kernels, same signature as ftab[] */
+extern const struct ftab ftab_wtf8[];
+extern const int ftab_wtf8_size;
+
+/* Modified UTF-8 to UTF-8 converters, see utf8_from_mutf8() */
+struct ftab_conv {
+    const char *name;
+    int (*func)(const unsigned char *src, size_t len,
+                unsigned char *dst, size_t *dst_len);
+};
+
+extern const struct ftab_conv ftab_mutf8_conv[];
+extern const int ftab_mutf8_conv_size;
+
+#endif
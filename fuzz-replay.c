@@ -0,0 +1,170 @@
+/*
+ * Standalone driver for fuzz.c, no fuzzing runtime required
+ *
+ * ./utf8-fuzz-replay FILE...        ==> replay corpus files or crash inputs
+ * ./utf8-fuzz-replay -n NUM [SEED]  ==> run NUM random inputs
+ * ./utf8-fuzz-replay < FILE         ==> replay stdin (e.g., for AFL)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint64_t s_seed = 0x2545F4914F6CDD1DULL;
+
+/* xorshift64*, deterministic across platforms */
+static uint32_t rnd(void)
+{
+    s_seed ^= s_seed >> 12;
+    s_seed ^= s_seed << 25;
+    s_seed ^= s_seed >> 27;
+    return (s_seed * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+/* Encode one random code point, return bytes written */
+static int rnd_char(unsigned char *p)
+{
+    uint32_t u;
+
+    switch (rnd() % 5) {
+    case 0:
+        p[0] = rnd() % 0x80;
+        return 1;
+    case 1:
+        u = 0x80 + rnd() % (0x800 - 0x80);
+        p[0] = 0xC0 | (u >> 6);
+        p[1] = 0x80 | (u & 0x3F);
+        return 2;
+    case 2:
+        do {
+            u = 0x800 + rnd() % (0x10000 - 0x800);
+        } while (u >= 0xD800 && u <= 0xDFFF);
+        p[0] = 0xE0 | (u >> 12);
+        p[1] = 0x80 | ((u >> 6) & 0x3F);
+        p[2] = 0x80 | (u & 0x3F);
+        return 3;
+    case 3:
+        /* Modified UTF-8: C0 80, or surrogate pair of CESU-8 */
+        if (rnd() % 2) {
+            p[0] = 0xC0;
+            p[1] = 0x80;
+            return 2;
+        }
+        u = rnd() % 0x100000;
+        p[0] = p[3] = 0xED;
+        p[1] = 0xA0 | (u >> 16);
+        p[2] = 0x80 | ((u >> 10) & 0x3F);
+        p[4] = 0xB0 | ((u >> 6) & 0x0F);
+        p[5] = 0x80 | (u & 0x3F);
+        return 6;
+    default:
+        u = 0x10000 + rnd() % (0x110000 - 0x10000);
+        p[0] = 0xF0 | (u >> 18);
+        p[1] = 0x80 | ((u >> 12) & 0x3F);
+        p[2] = 0x80 | ((u >> 6) & 0x3F);
+        p[3] = 0x80 | (u & 0x3F);
+        return 4;
+    }
+}
+
+/* Mostly valid text with sparse corruption, sized around block seams */
+static int rnd_input(unsigned char *buf, int max_len)
+{
+    int len = rnd() % 8 ? rnd() % 160 : rnd() % max_len;
+    int n = 0;
+
+    /* Long ascii runs are common in real text */
+    while (n + 6 <= len) {
+        if (rnd() % 4 == 0)
+            buf[n++] = 'a' + rnd() % 26;
+        else
+            n += rnd_char(buf + n);
+    }
+    while (n < len)
+        buf[n++] = rnd() % 0x80;
+
+    if (len && rnd() % 2) {
+        int errs = 1 + rnd() % 3;
+        while (errs-- && len) {
+            int i = rnd() % len;
+            switch (rnd() % 4) {
+            case 0:
+                buf[i] = rnd();
+                break;
+            case 1:
+                buf[i] ^= 1 << (rnd() % 8);
+                break;
+            case 2:
+                /* Special First Bytes */
+                buf[i] = "\xC0\xC1\xC2\xE0\xED\xF0\xF4\xF5"[rnd() % 8];
+                break;
+            default:
+                /* Truncate input at random point */
+                len = i;
+                break;
+            }
+        }
+    }
+
+    return len;
+}
+
+static int replay(FILE *fp, const char *name)
+{
+    size_t cap = 4096, len = 0, n;
+    unsigned char *data = malloc(cap);
+
+    while ((n = fread(data + len, 1, cap - len, fp)) > 0) {
+        len += n;
+        if (len == cap)
+            data = realloc(data, cap *= 2);
+    }
+
+    fprintf(stderr, "replay %s (%zu bytes)... ", name, len);
+    LLVMFuzzerTestOneInput(data, len);
+    fprintf(stderr, "pass\n");
+
+    free(data);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 3 && strcmp(argv[1], "-n") == 0) {
+        const int max_len = 4096;
+        long iters = atol(argv[2]);
+
+        if (argc >= 4)
+            s_seed = strtoull(argv[3], NULL, 0) | 1;
+
+        for (long i = 0; i < iters; ++i) {
+            /* Exact sized heap buffer so sanitizers can catch overreads */
+            unsigned char tmp[max_len];
+            int len = rnd_input(tmp, max_len);
+            unsigned char *data = malloc(len ? len : 1);
+
+            memcpy(data, tmp, len);
+            LLVMFuzzerTestOneInput(data, len);
+            free(data);
+        }
+        printf("%ld random inputs: pass\n", iters);
+        return 0;
+    }
+
+    if (argc == 1)
+        return replay(stdin, "stdin");
+
+    for (int i = 1; i < argc; ++i) {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp) {
+            perror(argv[i]);
+            return 1;
+        }
+        replay(fp, argv[i]);
+        fclose(fp);
+    }
+
+    return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Differential fuzzer
+ *
+ * Feed the same input to all validation kernels in ftab[] and all UTF-8 to
+ * UTF-16 transcoders. They must agree with utf8_naive, utf8_lookup and iconv,
+ * including the error position when a kernel reports one. Counting kernels in
+ * ftab_count[] must also agree with utf8_naive_count, index kernels in
+ * ftab_index[] with naive_index, ftab_skip[] with naive_skip, ftab_json[]
+ * with naive_json, ftab_lines[] with naive_lines. Streaming validation of
+ * input in chunks, iovec segments and a ring buffer must agree with
+ * utf8_naive. NUL terminated string kernels in ftab_cstr[] check input up
+ * to first NUL. Policy kernels in ftab_policy[] must agree with
+ * utf8_policy_naive. CESU-8, MUTF-8 and WTF-8 kernels and converters must
+ * agree with their naive versions.
+ *
+ * Build with libFuzzer: "make utf8-fuzz"
+ * Standalone replay/random driver (no fuzzing runtime): "make utf8-fuzz-replay"
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "ftab.h"
+#include "utf8range.h"
+
+int utf8_naive(const unsigned char *data, int len);
+int utf8_lookup(const unsigned char *data, int len);
+int utf8_naive_count(const unsigned char *data, int len, size_t *count);
+int utf8_policy_naive(const unsigned char *data, int len, unsigned int policy);
+int utf8_cesu8_naive(const unsigned char *data, int len);
+int utf8_mutf8_naive(const unsigned char *data, int len);
+int utf8_wtf8_naive(const unsigned char *data, int len);
+int utf8_mutf8_to_utf8_naive(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len);
+
+int utf8_to16_iconv(const unsigned char *buf8, size_t len8,
+        unsigned short *buf16, size_t *len16);
+int utf8_to16_naive(const unsigned char *buf8, size_t len8,
+        unsigned short *buf16, size_t *len16);
+
+static const struct {
+    const char *name;
+    int (*func)(const unsigned char *buf8, size_t len8,
+            unsigned short *buf16, size_t *len16);
+} ftab16[] = {
+    {
+        .name = "to16_naive",
+        .func = utf8_to16_naive,
+    },
+    {
+        .name = "utf8_to_utf16",
+        .func = utf8_to_utf16,
+    },
+};
+
+/* Keep inputs small enough for int lengths and fast iterations */
+#define FUZZ_MAX_LEN    (1024*1024)
+
+static void fail(const char *name, const unsigned char *data, int len,
+                 int ret, int expected)
+{
+    fprintf(stderr, "MISMATCH %s: returns %d, expects %d, len=%d\n",
+            name, ret, expected, len);
+    for (int i = 0; i < len; ++i)
+        fprintf(stderr, "\\x%02X", data[i]);
+    fprintf(stderr, "\n");
+    abort();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size > FUZZ_MAX_LEN)
+        return 0;
+
+    const int len = size;
+
+    /* Reference answer: 0 or index(1 based) of first error char */
+    const int ref = utf8_naive(data, len);
+
+    if ((utf8_lookup(data, len) == 0) != (ref == 0))
+        fail("lookup", data, len, utf8_lookup(data, len), ref);
+
+    for (int i = 0; i < ftab_size; ++i) {
+        int ret = ftab[i].func(data, len);
+
+        /* Kernels report -1 or first error index on failure */
+        if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref))
+            fail(ftab[i].name, data, len, ret, ref);
+    }
+
+    /* Count is exact on success, and on failure if error index reported */
+    size_t ref_count = 0;
+    const int ref_naive_count = utf8_naive_count(data, len, &ref_count);
+    if (ref_naive_count != ref)
+        fail("naive_count", data, len, ref_naive_count, ref);
+    for (int i = 0; i < ftab_count_size; ++i) {
+        size_t count = -1;
+        int ret = ftab_count[i].func(data, len, &count);
+
+        if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref))
+            fail(ftab_count[i].name, data, len, ret, ref);
+        if (ret >= 0 && count != ref_count)
+            fail(ftab_count[i].name, data, len, (int)count, (int)ref_count);
+    }
+
+    /* Index built by all kernels is the same, spot check some offsets */
+    int *ref_index = malloc((UTF8_INDEX_SIZE(len) + 1) * sizeof(int));
+    int *index = malloc((UTF8_INDEX_SIZE(len) + 1) * sizeof(int));
+    const int ref_naive_index = ftab_index[0].build(data, len, ref_index,
+                                                    &ref_count);
+    if (ref_naive_index != ref)
+        fail(ftab_index[0].name, data, len, ref_naive_index, ref);
+    for (int i = 1; i < ftab_index_size; ++i) {
+        size_t count = -1;
+        int ret = ftab_index[i].build(data, len, index, &count);
+
+        if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref))
+            fail(ftab_index[i].name, data, len, ret, ref);
+        if (ret < 0)
+            continue;
+        if (count != ref_count)
+            fail(ftab_index[i].name, data, len, (int)count, (int)ref_count);
+        if (memcmp(index, ref_index, UTF8_INDEX_SIZE(count) * sizeof(int)))
+            fail(ftab_index[i].name, data, len, -1, -1);
+        for (size_t k = 0; ret == 0 && k <= count + 1; k += 1 + k / 4) {
+            int off = ftab_index[i].offset(data, len, index, count, k);
+            int ref_off = ftab_index[0].offset(data, len, ref_index,
+                                               count, k);
+            if (off != ref_off)
+                fail(ftab_index[i].name, data, len, off, ref_off);
+        }
+    }
+    free(ref_index);
+    free(index);
+
+    /* Skip chars of valid prefix */
+    const int valid = ref ? ref - 1 : len;
+    utf8_naive_count(data, valid, &ref_count);
+    for (size_t k = 0; k <= ref_count + 1; k += 1 + k / 4) {
+        const int ref_off = ftab_skip[0].func(data, valid, k);
+
+        for (int i = 1; i < ftab_skip_size; ++i) {
+            int off = ftab_skip[i].func(data, valid, k);
+            if (off != ref_off)
+                fail(ftab_skip[i].name, data, valid, off, ref_off);
+        }
+    }
+
+    /* JSON escapes of valid prefix */
+    uint64_t *ref_mask = malloc(UTF8_JSON_MASK_SIZE(len) * sizeof(uint64_t));
+    uint64_t *mask = malloc(UTF8_JSON_MASK_SIZE(len) * sizeof(uint64_t));
+    size_t ref_escapes;
+    const int ref_json = ftab_json[0].func(data, len, ref_mask, &ref_escapes);
+    if (ref_json != ref)
+        fail(ftab_json[0].name, data, len, ref_json, ref);
+    for (int i = 1; i < ftab_json_size; ++i) {
+        size_t escapes = -1;
+        int ret = ftab_json[i].func(data, len, mask, &escapes);
+
+        if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref))
+            fail(ftab_json[i].name, data, len, ret, ref);
+        if (ret >= 0 && (escapes != ref_escapes ||
+                memcmp(mask, ref_mask,
+                       UTF8_JSON_MASK_SIZE(valid) * sizeof(uint64_t))))
+            fail(ftab_json[i].name, data, len, (int)escapes,
+                 (int)ref_escapes);
+    }
+    free(ref_mask);
+    free(mask);
+
+    /* Lines with one and many delimiters, ends[] long enough or not */
+    static const char *delims[] = { "\n", "\n\r,\x01" };
+    int *ref_ends = malloc((len + 1) * sizeof(int));
+    int *ref_errors = malloc((len + 1) * sizeof(int));
+    int *ends = malloc((len + 1) * sizeof(int));
+    int *errors = malloc((len + 1) * sizeof(int));
+    for (int d = 0; d < 2; ++d) {
+        const int max_lines = d ? len + 1 : 3;
+        const int ref_lines = ftab_lines[0].func(data, len, delims[d],
+                ref_ends, ref_errors, max_lines);
+
+        for (int i = 1; i < ftab_lines_size; ++i) {
+            int n = ftab_lines[i].func(data, len, delims[d], ends, errors,
+                                       max_lines);
+            if (n != ref_lines)
+                fail(ftab_lines[i].name, data, len, n, ref_lines);
+            for (int k = 0; k < n; ++k) {
+                if (ends[k] != ref_ends[k] || errors[k] != ref_errors[k])
+                    fail(ftab_lines[i].name, data, len, errors[k],
+                         ref_errors[k]);
+            }
+        }
+    }
+    free(ref_ends);
+    free(ref_errors);
+    free(ends);
+    free(errors);
+
+    /* Stream in chunks of sizes taken from input, chars span chunks */
+    struct utf8_stream stream;
+    utf8_stream_init(&stream);
+    for (int i = 0, j = 0; i < len; ++j) {
+        int n = data[j % len] % 67 + 1;
+
+        if (n > len - i)
+            n = len - i;
+        utf8_stream_update(&stream, data + i, n);
+        i += n;
+    }
+    const long long stream_ret = utf8_stream_finish(&stream);
+    if (stream_ret != ref)
+        fail("stream", data, len, (int)stream_ret, ref);
+
+    /* Same as segments, odd ones may be empty */
+    struct iovec *iov = malloc((len * 2 + 1) * sizeof(struct iovec));
+    int cnt = 0;
+    for (int i = 0, j = 0; i < len; ++j) {
+        int n = data[j % len] % 37 + (j % 2 == 0);
+
+        if (n > len - i)
+            n = len - i;
+        iov[cnt].iov_base = (void *)(data + i);
+        iov[cnt++].iov_len = n;
+        i += n;
+    }
+    const long long iov_ret = utf8_validate_iov(iov, cnt);
+    free(iov);
+    if (iov_ret != ref)
+        fail("iov", data, len, (int)iov_ret, ref);
+
+    /* Producer writes chunks into a small ring */
+    unsigned char ring[61];
+    struct utf8_ring r;
+    int head = len % 61;
+    utf8_ring_init(&r, head);
+    for (int i = 0, j = 0; i < len; ++j) {
+        int n = data[j % len] % 60 + 1;
+
+        if (n > len - i)
+            n = len - i;
+        for (int k = 0; k < n; ++k, head = (head + 1) % 61)
+            ring[head] = data[i++];
+        utf8_ring_update(&r, ring, 61, head);
+    }
+    const long long ring_ret = utf8_ring_finish(&r);
+    if (ring_ret != ref)
+        fail("ring", data, len, (int)ring_ret, ref);
+
+    /* Each policy alone and all together, policy 0 is plain validation */
+    static const unsigned int policies[] = {
+        0, UTF8_POLICY_NUL, UTF8_POLICY_CONTROL, UTF8_POLICY_C1,
+        UTF8_POLICY_NONCHAR, UTF8_POLICY_PRIVATE, 0x1F,
+    };
+    for (int k = 0; k < sizeof(policies)/sizeof(policies[0]); ++k) {
+        const unsigned int policy = policies[k];
+        const int ref_policy = utf8_policy_naive(data, len, policy);
+
+        if (policy == 0 && ref_policy != ref)
+            fail("policy_naive", data, len, ref_policy, ref);
+        for (int i = 0; i < ftab_policy_size; ++i) {
+            int ret = ftab_policy[i].func(data, len, policy);
+
+            if ((ret == 0) != (ref_policy == 0) ||
+                    (ret > 0 && ret != ref_policy))
+                fail(ftab_policy[i].name, data, len, ret, ref_policy);
+        }
+    }
+
+    /* CESU-8, MUTF-8 and WTF-8 */
+    const int ref_cesu8 = utf8_cesu8_naive(data, len);
+    for (int i = 0; i < ftab_cesu8_size; ++i) {
+        int ret = ftab_cesu8[i].func(data, len);
+
+        if ((ret == 0) != (ref_cesu8 == 0) || (ret > 0 && ret != ref_cesu8))
+            fail(ftab_cesu8[i].name, data, len, ret, ref_cesu8);
+    }
+
+    const int ref_mutf8 = utf8_mutf8_naive(data, len);
+    for (int i = 0; i < ftab_mutf8_size; ++i) {
+        int ret = ftab_mutf8[i].func(data, len);
+
+        if ((ret == 0) != (ref_mutf8 == 0) || (ret > 0 && ret != ref_mutf8))
+            fail(ftab_mutf8[i].name, data, len, ret, ref_mutf8);
+    }
+
+    const int ref_wtf8 = utf8_wtf8_naive(data, len);
+    for (int i = 0; i < ftab_wtf8_size; ++i) {
+        int ret = ftab_wtf8[i].func(data, len);
+
+        if ((ret == 0) != (ref_wtf8 == 0) || (ret > 0 && ret != ref_wtf8))
+            fail(ftab_wtf8[i].name, data, len, ret, ref_wtf8);
+    }
+
+    /* Output never exceeds input */
+    unsigned char *ref8 = malloc(size + 1);
+    unsigned char *buf8 = malloc(size + 1);
+    size_t ref_len8 = size;
+
+    const int ref_conv = utf8_mutf8_to_utf8_naive(data, size, ref8, &ref_len8);
+    if (ref_conv != ref_mutf8)
+        fail("mutf8_to_utf8_naive", data, len, ref_conv, ref_mutf8);
+
+    for (int i = 0; i < ftab_mutf8_conv_size; ++i) {
+        size_t len8 = size;
+        int ret = ftab_mutf8_conv[i].func(data, size, buf8, &len8);
+
+        if ((ret == 0) != (ref_conv == 0) || (ret > 0 && ret != ref_conv))
+            fail(ftab_mutf8_conv[i].name, data, len, ret, ref_conv);
+        if (ret == 0 && (len8 != ref_len8 || memcmp(buf8, ref8, len8)))
+            fail(ftab_mutf8_conv[i].name, data, len, (int)len8,
+                 (int)ref_len8);
+    }
+
+    free(ref8);
+    free(buf8);
+
+    /*
+     * NUL terminated copy, stops at first NUL of input. Kernels load aligned
+     * blocks up to 64 bytes beyond NUL, allocate whole blocks to keep
+     * sanitizers quiet.
+     */
+    char *str = aligned_alloc(64, (size + 1 + 63) / 64 * 64);
+    memcpy(str, data, size);
+    str[size] = 0;
+    const int ref_len = strlen(str);
+    const int ref_cstr = utf8_naive(data, ref_len);
+
+    for (int i = 0; i < ftab_cstr_size; ++i) {
+        size_t len_cstr = 0;
+        int ret = ftab_cstr[i].func(str, &len_cstr);
+
+        if ((ret == 0) != (ref_cstr == 0) || (ret > 0 && ret != ref_cstr))
+            fail(ftab_cstr[i].name, data, ref_len, ret, ref_cstr);
+        if (len_cstr != ref_len)
+            fail(ftab_cstr[i].name, data, ref_len, (int)len_cstr, ref_len);
+    }
+    free(str);
+
+    /* UTF-16 buffer large enough, -1 (overflow) is never expected */
+    const size_t cap16 = size * 2 + 2;
+    unsigned short *ref16 = malloc(cap16);
+    unsigned short *buf16 = malloc(cap16);
+    size_t ref_len16 = cap16;
+
+    int ref_iconv = utf8_to16_iconv(data, size, ref16, &ref_len16);
+    if (ref_iconv != ref)
+        fail("to16_iconv", data, len, ref_iconv, ref);
+
+    for (int i = 0; i < sizeof(ftab16)/sizeof(ftab16[0]); ++i) {
+        size_t len16 = cap16;
+        int ret = ftab16[i].func(data, size, buf16, &len16);
+
+        if (ret != ref_iconv)
+            fail(ftab16[i].name, data, len, ret, ref_iconv);
+        if (len16 != ref_len16 || memcmp(buf16, ref16, len16))
+            fail(ftab16[i].name, data, len, (int)len16, (int)ref_len16);
+    }
+
+    free(ref16);
+    free(buf16);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stddef.h>
+
+#include "utf8range.h"
+
+/*
+ * Sparse char index, one byte offset every UTF8_INDEX_STRIDE chars
+ *
+ * Chars of well-formed string are bytes other than 80..BF. Offset of char k
+ * is found by looking up entry k / STRIDE, then skipping k % STRIDE chars.
+ * With 4 bytes entries, the index takes at most 4 / STRIDE of text size
+ * (3% for ascii text, 1% for CJK text).
+ */
+
+int utf8_naive(const unsigned char *data, int len);
+
+#define IS_LEAD(b)  ((signed char)(b) > (signed char)0xBF)
+
+/*
+ * Validate and build index
+ * Return same as utf8_naive(), index and *count cover chars before first
+ * error char
+ */
+int utf8_naive_index(const unsigned char *data, int len, int *index,
+                     size_t *count)
+{
+    const int err = utf8_naive(data, len);
+    const int valid = err ? err - 1 : len;
+    size_t n = 0;
+
+    for (int i = 0; i < valid; ++i) {
+        if (IS_LEAD(data[i])) {
+            if (n % UTF8_INDEX_STRIDE == 0)
+                index[n / UTF8_INDEX_STRIDE] = i;
+            ++n;
+        }
+    }
+
+    *count = n;
+    return err;
+}
+
+/* Byte offset of k-th char, len if there are exactly k chars, -1 if less */
+int utf8_naive_skip_chars(const unsigned char *data, int len, size_t k)
+{
+    for (int pos = 0; pos < len; ++pos) {
+        if (IS_LEAD(data[pos])) {
+            if (k == 0)
+                return pos;
+            --k;
+        }
+    }
+
+    return k ? -1 : len;
+}
+
+/* Byte offset of k-th char, len if k == count, -1 if k > count */
+int utf8_naive_index_offset(const unsigned char *data, int len,
+                            const int *index, size_t count, size_t k)
+{
+    if (k >= count)
+        return k == count ? len : -1;
+
+    const int base = index[k / UTF8_INDEX_STRIDE];
+    return base + utf8_naive_skip_chars(data + base, len - base,
+                                        k % UTF8_INDEX_STRIDE);
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * JSON string escapes
+ * https://www.rfc-editor.org/rfc/rfc8259#section-7
+ *
+ * Quotation mark, reverse solidus and control characters U+0000..U+001F
+ * must be escaped in JSON strings, all other code points may be copied as
+ * is. Escapes are returned as a bitmask, bit (i % 64) of mask[i / 64] is
+ * set if byte i needs escape. Bits beyond string end are 0.
+ */
+
+int utf8_naive(const unsigned char *data, int len);
+
+#define IS_ESCAPE(b)    ((b) < 0x20 || (b) == '"' || (b) == '\\')
+
+/*
+ * Validate and find escapes
+ * Return same as utf8_naive(), mask and *escapes cover bytes before first
+ * error char
+ */
+int utf8_json_naive(const unsigned char *data, int len, uint64_t *mask,
+                    size_t *escapes)
+{
+    const int err = utf8_naive(data, len);
+    const int valid = err ? err - 1 : len;
+    size_t n = 0;
+
+    for (int i = 0; i < (valid + 63) / 64; ++i)
+        mask[i] = 0;
+
+    for (int i = 0; i < valid; ++i) {
+        if (IS_ESCAPE(data[i])) {
+            mask[i / 64] |= 1ULL << (i % 64);
+            ++n;
+        }
+    }
+
+    *escapes = n;
+    return err;
+}
@@ -0,0 +1,34 @@
+#include <string.h>
+
+/*
+ * Line (record) splitting for log and CSV ingestion
+ *
+ * Lines end with any byte of a delimiter set, e.g., "\n" or "\n\r". Bytes
+ * after the last delimiter form the last line, which ends at string end.
+ * Each line is validated alone, error index is relative to line start.
+ * Delimiters must be ascii, so a delimiter is never part of a multi-byte
+ * char and one ill-formed line doesn't affect others.
+ */
+
+int utf8_naive(const unsigned char *data, int len);
+
+/*
+ * Find lines and validate them
+ * Return count of lines saved to ends[] and errors[], at most max_lines
+ */
+int utf8_lines_naive(const unsigned char *data, int len, const char *delims,
+                     int *ends, int *errors, int max_lines)
+{
+    int n = 0, start = 0;
+
+    for (int i = 0; i <= len && n < max_lines; ++i) {
+        if (i < len ? (data[i] && strchr(delims, data[i])) : start < len) {
+            ends[n] = i;
+            errors[n] = utf8_naive(data + start, i - start);
+            ++n;
+            start = i + 1;
+        }
+    }
+
+    return n;
+}
@@ -39,3 +39,68 @@ int utf8_lookup(const unsigned char *data, int len)
 
     return state == UTF8_ACCEPT ? 0 : -1;
 }
+
+#define STRIPES         6
+#define STRIPE_MIN      64      /* Shorter buffers use utf8_lookup() */
+
+/*
+ * Same DFA on STRIPES parts of the buffer in one loop. The dependent load
+ * chains of stripes are independent, so they overlap in the pipeline.
+ * Each stripe starts at a char boundary: a split point is moved over at
+ * most 3 Continuation Bytes. More than 3 is an error, that stripe starts
+ * with a Continuation Byte and is rejected. REJECT is a sink, states are
+ * only checked between blocks and at stripe ends.
+ * Return 0 on success, -1 on error
+ */
+int utf8_lookup_stripe(const unsigned char *data, int len)
+{
+    const unsigned char *p[STRIPES], *end[STRIPES];
+    int state[STRIPES] = { 0 };
+
+    if (len < STRIPE_MIN * STRIPES)
+        return utf8_lookup(data, len);
+
+    p[0] = data;
+    for (int k = 1; k < STRIPES; ++k) {
+        const unsigned char *q = data + (long)len * k / STRIPES;
+
+        for (int i = 0; i < 3 && (signed char)*q < (signed char)0xC0; ++i)
+            ++q;
+        p[k] = end[k-1] = q;
+    }
+    end[STRIPES-1] = data + len;
+
+    /* Common length of stripes, in blocks for early exit on error */
+    int n = end[0] - p[0];
+    for (int k = 1; k < STRIPES; ++k)
+        if (end[k] - p[k] < n)
+            n = end[k] - p[k];
+
+    while (n) {
+        const int block = n < 256 ? n : 256;
+        int reject = 0;
+
+        for (int i = 0; i < block; ++i)
+            for (int k = 0; k < STRIPES; ++k)
+                state[k] = utf8s[state[k] + utf8d[p[k][i]]];
+        for (int k = 0; k < STRIPES; ++k) {
+            p[k] += block;
+            reject |= state[k] == UTF8_REJECT;
+        }
+        if (reject)
+            return -1;
+        n -= block;
+    }
+
+    /* Stripes differ by a few bytes */
+    for (int k = 0; k < STRIPES; ++k) {
+        int s = state[k];
+
+        while (p[k] < end[k])
+            s = utf8s[s + utf8d[*p[k]++]];
+        if (s != UTF8_ACCEPT)
+            return -1;
+    }
+
+    return 0;
+}
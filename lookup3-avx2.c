@@ -0,0 +1,200 @@
+/*
+ * Lookup algorithm, AVX2 version
+ * See lookup3-sse.c for algorithm details
+ */
+#ifdef __AVX2__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+int utf8_swar(const unsigned char *data, int len);
+
+/* Error types, bit 7 (TWO_CONTS) is cleared by 3rd and 4th bytes */
+#define TOO_SHORT       (1 << 0)    /* Lead byte followed by non continuation */
+#define TOO_LONG        (1 << 1)    /* Continuation after ascii */
+#define OVERLONG_3      (1 << 2)    /* E0 80~9F */
+#define TOO_LARGE       (1 << 3)    /* F4 90~BF, F5~FF */
+#define SURROGATE       (1 << 4)    /* ED A0~BF */
+#define OVERLONG_2      (1 << 5)    /* C0, C1 */
+#define TOO_LARGE_1000  (1 << 6)    /* F5~FF 80~8F */
+#define OVERLONG_4      (1 << 6)    /* F0 80~8F */
+#define TWO_CONTS       (1 << 7)    /* Continuation after continuation */
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* Indexed by high nibble of previous byte */
+static const uint8_t _byte1_high_tbl[] = {
+    /* 0_______ ________: ascii */
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    /* 10______ ________: continuation */
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    /* 1100____ ________ */
+    TOO_SHORT | OVERLONG_2,
+    /* 1101____ ________ */
+    TOO_SHORT,
+    /* 1110____ ________ */
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    /* 1111____ ________ */
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+/* Indexed by low nibble of previous byte */
+static const uint8_t _byte1_low_tbl[] = {
+    /* ____0000 ________ */
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    /* ____0001 ________ */
+    CARRY | OVERLONG_2,
+    /* ____001_ ________ */
+    CARRY,
+    CARRY,
+    /* ____0100 ________ */
+    CARRY | TOO_LARGE,
+    /* ____0101 ~ ____1100 ________ */
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    /* ____1101 ________ */
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    /* ____111_ ________ */
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+/* Indexed by high nibble of current byte */
+static const uint8_t _byte2_high_tbl[] = {
+    /* ________ 0_______: ascii */
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    /* ________ 1000____ */
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    /* ________ 1001____ */
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    /* ________ 101_____ */
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    /* ________ 11______: lead byte */
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/*
+ * Non-zero if last 3 bytes of a vector start an incomplete character, only
+ * checked when next vector is ascii
+ */
+static const uint8_t _incomplete_tbl[] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+static inline __m256i push_last_byte_of_a_to_b(__m256i a, __m256i b) {
+  return _mm256_alignr_epi8(b, _mm256_permute2x128_si256(a, b, 0x21), 15);
+}
+
+static inline __m256i push_last_2bytes_of_a_to_b(__m256i a, __m256i b) {
+  return _mm256_alignr_epi8(b, _mm256_permute2x128_si256(a, b, 0x21), 14);
+}
+
+static inline __m256i push_last_3bytes_of_a_to_b(__m256i a, __m256i b) {
+  return _mm256_alignr_epi8(b, _mm256_permute2x128_si256(a, b, 0x21), 13);
+}
+
+/* Return 0 - success, -1 - error */
+int utf8_lookup3_avx2(const unsigned char *data, int len)
+{
+    if (len >= 32) {
+        __m256i prev_input = _mm256_set1_epi8(0);
+        __m256i error = _mm256_set1_epi8(0);
+
+        /* Cached tables, nibble tables are same for both 128 bits lanes */
+        const __m256i byte1_high_tbl =
+            _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i *)_byte1_high_tbl));
+        const __m256i byte1_low_tbl =
+            _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i *)_byte1_low_tbl));
+        const __m256i byte2_high_tbl =
+            _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i *)_byte2_high_tbl));
+        const __m256i incomplete_tbl =
+            _mm256_loadu_si256((const __m256i *)_incomplete_tbl);
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+
+        while (len >= 32) {
+            const __m256i input = _mm256_loadu_si256((const __m256i *)data);
+
+            if (_mm256_movemask_epi8(input) == 0) {
+                /* Ascii: only last character of previous vector may fail */
+                error = _mm256_or_si256(error,
+                        _mm256_subs_epu8(prev_input, incomplete_tbl));
+            } else {
+                /* prev1 = (input, prev_input) << 1 byte */
+                const __m256i prev1 =
+                    push_last_byte_of_a_to_b(prev_input, input);
+
+                /* Classify each (prev1, input) byte pair */
+                __m256i byte1_high = _mm256_shuffle_epi8(byte1_high_tbl,
+                        _mm256_and_si256(_mm256_srli_epi16(prev1, 4),
+                                         nibble_mask));
+                __m256i byte1_low = _mm256_shuffle_epi8(byte1_low_tbl,
+                        _mm256_and_si256(prev1, nibble_mask));
+                __m256i byte2_high = _mm256_shuffle_epi8(byte2_high_tbl,
+                        _mm256_and_si256(_mm256_srli_epi16(input, 4),
+                                         nibble_mask));
+                __m256i special = _mm256_and_si256(
+                        _mm256_and_si256(byte1_high, byte1_low), byte2_high);
+
+                /*
+                 * 3rd and 4th bytes are continuations after continuation,
+                 * flip TWO_CONTS for them. Remaining bit 7 is an error:
+                 * either 3rd/4th byte is missing or extra TWO_CONTS.
+                 */
+                const __m256i prev2 =
+                    push_last_2bytes_of_a_to_b(prev_input, input);
+                const __m256i prev3 =
+                    push_last_3bytes_of_a_to_b(prev_input, input);
+                /* Bit 7 set iff prev2 >= E0 or prev3 >= F0 */
+                __m256i must23 = _mm256_or_si256(
+                        _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80)),
+                        _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80)));
+                must23 = _mm256_and_si256(must23, _mm256_set1_epi8(0x80));
+
+                error = _mm256_or_si256(error,
+                                        _mm256_xor_si256(must23, special));
+            }
+
+            prev_input = input;
+            data += 32;
+            len -= 32;
+        }
+
+        if (!_mm256_testz_si256(error, error))
+            return -1;
+
+        /* Find previous token (not 80~BF) */
+        int32_t token4 = _mm256_extract_epi32(prev_input, 7);
+        const int8_t *token = (const int8_t *)&token4;
+        int lookahead = 0;
+        if (token[3] > (int8_t)0xBF)
+            lookahead = 1;
+        else if (token[2] > (int8_t)0xBF)
+            lookahead = 2;
+        else if (token[1] > (int8_t)0xBF)
+            lookahead = 3;
+
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    /* Check remaining bytes with SWAR method */
+    return utf8_swar(data, len) ? -1 : 0;
+}
+
+#endif
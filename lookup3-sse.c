@@ -0,0 +1,183 @@
+/*
+ * Lookup algorithm by John Keiser and Daniel Lemire, used by simdjson/simdutf
+ * https://arxiv.org/abs/2010.03090
+ *
+ * Every two adjacent bytes are classified by three 16 entries tables, indexed
+ * by high nibble of previous byte, low nibble of previous byte and high
+ * nibble of current byte. Each table maps its nibble to a bitmask of error
+ * types the nibble may be part of. A pair is illegal iff all three nibbles
+ * agree on at least one error type, i.e., the bitwise AND is not zero.
+ */
+#ifdef __x86_64__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+int utf8_swar(const unsigned char *data, int len);
+
+/* Error types, bit 7 (TWO_CONTS) is cleared by 3rd and 4th bytes */
+#define TOO_SHORT       (1 << 0)    /* Lead byte followed by non continuation */
+#define TOO_LONG        (1 << 1)    /* Continuation after ascii */
+#define OVERLONG_3      (1 << 2)    /* E0 80~9F */
+#define TOO_LARGE       (1 << 3)    /* F4 90~BF, F5~FF */
+#define SURROGATE       (1 << 4)    /* ED A0~BF */
+#define OVERLONG_2      (1 << 5)    /* C0, C1 */
+#define TOO_LARGE_1000  (1 << 6)    /* F5~FF 80~8F */
+#define OVERLONG_4      (1 << 6)    /* F0 80~8F */
+#define TWO_CONTS       (1 << 7)    /* Continuation after continuation */
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* Indexed by high nibble of previous byte */
+static const uint8_t _byte1_high_tbl[] = {
+    /* 0_______ ________: ascii */
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    /* 10______ ________: continuation */
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    /* 1100____ ________ */
+    TOO_SHORT | OVERLONG_2,
+    /* 1101____ ________ */
+    TOO_SHORT,
+    /* 1110____ ________ */
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    /* 1111____ ________ */
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+/* Indexed by low nibble of previous byte */
+static const uint8_t _byte1_low_tbl[] = {
+    /* ____0000 ________ */
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    /* ____0001 ________ */
+    CARRY | OVERLONG_2,
+    /* ____001_ ________ */
+    CARRY,
+    CARRY,
+    /* ____0100 ________ */
+    CARRY | TOO_LARGE,
+    /* ____0101 ~ ____1100 ________ */
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    /* ____1101 ________ */
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    /* ____111_ ________ */
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+/* Indexed by high nibble of current byte */
+static const uint8_t _byte2_high_tbl[] = {
+    /* ________ 0_______: ascii */
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    /* ________ 1000____ */
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    /* ________ 1001____ */
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    /* ________ 101_____ */
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    /* ________ 11______: lead byte */
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/*
+ * Non-zero if last 3 bytes of a vector start an incomplete character, only
+ * checked when next vector is ascii
+ */
+static const uint8_t _incomplete_tbl[] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+/* Return 0 - success, -1 - error */
+int utf8_lookup3(const unsigned char *data, int len)
+{
+    if (len >= 16) {
+        __m128i prev_input = _mm_set1_epi8(0);
+        __m128i error = _mm_set1_epi8(0);
+
+        /* Cached tables */
+        const __m128i byte1_high_tbl =
+            _mm_loadu_si128((const __m128i *)_byte1_high_tbl);
+        const __m128i byte1_low_tbl =
+            _mm_loadu_si128((const __m128i *)_byte1_low_tbl);
+        const __m128i byte2_high_tbl =
+            _mm_loadu_si128((const __m128i *)_byte2_high_tbl);
+        const __m128i incomplete_tbl =
+            _mm_loadu_si128((const __m128i *)_incomplete_tbl);
+        const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+        while (len >= 16) {
+            const __m128i input = _mm_loadu_si128((const __m128i *)data);
+
+            if (_mm_movemask_epi8(input) == 0) {
+                /* Ascii: only last character of previous vector may fail */
+                error = _mm_or_si128(error,
+                        _mm_subs_epu8(prev_input, incomplete_tbl));
+            } else {
+                /* prev1 = (input, prev_input) << 1 byte */
+                const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+
+                /* Classify each (prev1, input) byte pair */
+                __m128i byte1_high = _mm_shuffle_epi8(byte1_high_tbl,
+                        _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble_mask));
+                __m128i byte1_low = _mm_shuffle_epi8(byte1_low_tbl,
+                        _mm_and_si128(prev1, nibble_mask));
+                __m128i byte2_high = _mm_shuffle_epi8(byte2_high_tbl,
+                        _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask));
+                __m128i special = _mm_and_si128(
+                        _mm_and_si128(byte1_high, byte1_low), byte2_high);
+
+                /*
+                 * 3rd and 4th bytes are continuations after continuation,
+                 * flip TWO_CONTS for them. Remaining bit 7 is an error:
+                 * either 3rd/4th byte is missing or extra TWO_CONTS.
+                 */
+                const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+                const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+                /* Bit 7 set iff prev2 >= E0 or prev3 >= F0 */
+                __m128i must23 = _mm_or_si128(
+                        _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+                        _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80)));
+                must23 = _mm_and_si128(must23, _mm_set1_epi8(0x80));
+
+                error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+            }
+
+            prev_input = input;
+            data += 16;
+            len -= 16;
+        }
+
+        if (!_mm_testz_si128(error, error))
+            return -1;
+
+        /* Find previous token (not 80~BF) */
+        int32_t token4 = _mm_extract_epi32(prev_input, 3);
+        const int8_t *token = (const int8_t *)&token4;
+        int lookahead = 0;
+        if (token[3] > (int8_t)0xBF)
+            lookahead = 1;
+        else if (token[2] > (int8_t)0xBF)
+            lookahead = 2;
+        else if (token[1] > (int8_t)0xBF)
+            lookahead = 3;
+
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    /* Check remaining bytes with SWAR method */
+    return utf8_swar(data, len) ? -1 : 0;
+}
+
+#endif
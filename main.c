@@ -7,60 +7,23 @@
 #include <sys/time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "ftab.h"
+#include "utf8range.h"
+#include "bulk.h"
+#include "scan.h"
+#include "filter.h"
 
-int utf8_naive(const unsigned char *data, int len);
-int utf8_lookup(const unsigned char *data, int len);
-int utf8_boost(const unsigned char *data, int len);
-int utf8_lemire(const unsigned char *data, int len);
 int utf8_range(const unsigned char *data, int len);
-int utf8_range2(const unsigned char *data, int len);
 #ifdef __AVX2__
-int utf8_lemire_avx2(const unsigned char *data, int len);
 int utf8_range_avx2(const unsigned char *data, int len);
 #endif
 
-static struct ftab {
-    const char *name;
-    int (*func)(const unsigned char *data, int len);
-} ftab[] = {
-    {
-        .name = "naive",
-        .func = utf8_naive,
-    },
-    {
-        .name = "lookup",
-        .func = utf8_lookup,
-    },
-    {
-        .name = "lemire",
-        .func = utf8_lemire,
-    },
-    {
-        .name = "range",
-        .func = utf8_range,
-    },
-    {
-        .name = "range2",
-        .func = utf8_range2,
-    },
-#ifdef __AVX2__
-    {
-        .name = "lemire_avx2",
-        .func = utf8_lemire_avx2,
-    },
-    {
-        .name = "range_avx2",
-        .func = utf8_range_avx2,
-    },
-#endif
-#ifdef BOOST
-    {
-        .name = "boost",
-        .func = utf8_boost,
-    },
-#endif
-};
-
 static unsigned char *load_test_buf(int len)
 {
     const char utf8[] = "\xF0\x90\xBF\x80";
@@ -147,6 +110,89 @@ static void prepare_test_buf(unsigned char *buf, const struct test *pos,
     }
 }
 
+/*
+ * Validate each legal and illegal token, then tokens concatenated to 1K and
+ * shifted to cover all alignments. Legal tokens must stay legal when
+ * concatenated in order (last one followed by first one).
+ * Return 0 on success, -1 on error
+ */
+static int test_tokens(const struct ftab *ftab,
+                       const struct test *pos, int pos_len,
+                       const struct test *neg, int neg_len)
+{
+    /* Test single token */
+    for (int i = 0; i < pos_len; ++i) {
+        if (ftab->func(pos[i].data, pos[i].len) != 0) {
+            printf("FAILED positive test: ");
+            print_test(pos[i].data, pos[i].len);
+            return -1;
+        }
+    }
+    for (int i = 0; i < neg_len; ++i) {
+        if (ftab->func(neg[i].data, neg[i].len) == 0) {
+            printf("FAILED negitive test: ");
+            print_test(neg[i].data, neg[i].len);
+            return -1;
+        }
+    }
+
+    /* Test shifted buffer to cover 1k length */
+    /* buffer size must be greater than 1024 + 16 + max(test string length) */
+    const int max_size = 1024*2;
+    uint64_t buf64[max_size/8 + 2];
+    /* Offset 8 bytes by 1 byte */
+    unsigned char *buf = ((unsigned char *)buf64) + 1;
+    int buf_len;
+
+    for (int i = 0; i < pos_len; ++i) {
+        /* Positive test: shift 16 bytes, validate each shift */
+        prepare_test_buf(buf, pos, pos_len, i);
+        buf_len = 1024;
+        for (int j = 0; j < 16; ++j) {
+            if (ftab->func(buf, buf_len) != 0) {
+                printf("FAILED positive test: ");
+                print_test(buf, buf_len);
+                return -1;
+            }
+            for (int k = buf_len; k >= 1; --k)
+                buf[k] = buf[k-1];
+            buf[0] = '\x55';
+            ++buf_len;
+        }
+
+        /* Negative test: trunk last non ascii */
+        while (buf_len >= 1 && buf[buf_len-1] <= 0x7F)
+            --buf_len;
+        if (buf_len && ftab->func(buf, buf_len-1) == 0) {
+            printf("FAILED negitive test: ");
+            print_test(buf, buf_len);
+            return -1;
+        }
+    }
+
+    /* Negative test */
+    for (int i = 0; i < neg_len; ++i) {
+        /* Append one error token, shift 16 bytes, validate each shift */
+        int pos_idx = i % pos_len;
+        prepare_test_buf(buf, pos, pos_len, pos_idx);
+        memcpy(buf+1024, neg[i].data, neg[i].len);
+        buf_len = 1024 + neg[i].len;
+        for (int j = 0; j < 16; ++j) {
+            if (ftab->func(buf, buf_len) == 0) {
+                printf("FAILED negative test: ");
+                print_test(buf, buf_len);
+                return -1;
+            }
+            for (int k = buf_len; k >= 1; --k)
+                buf[k] = buf[k-1];
+            buf[0] = '\x66';
+            ++buf_len;
+        }
+    }
+
+    return 0;
+}
+
 /* Return 0 on success, -1 on error */
 static int test_manual(const struct ftab *ftab)
 {
@@ -210,179 +256,2852 @@ static int test_manual(const struct ftab *ftab)
          "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xF0" \
          "\x80\x80\x80", 35},
     };
+#pragma GCC diagnostic pop
+
+    return test_tokens(ftab, pos, sizeof(pos)/sizeof(pos[0]),
+                       neg, sizeof(neg)/sizeof(neg[0]));
+}
+
+/* Return 0 on success, -1 on error */
+static int test_wtf8_manual(const struct ftab *ftab)
+{
 #pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-sign"
+    /* positive tests, no high surrogate at end is followed by low one */
+    static const struct test pos[] = {
+        {"", 0},
+        {"\x00", 1},
+        {"\x66", 1},
+        {"\xED\xA0\x80", 3},
+        {"\xED\x9F\xBF", 3},
+        {"\xED\xBF\xBF", 3},
+        {"\xED\xB0\x80\xED\xA0\x80", 6},
+        {"\x7F", 1},
+        {"\xED\xAF\xBF\x41\xED\xB0\x80", 7},
+        {"\xED\xA0\x80\xED\xA0\x80", 6},
+        {"\xEF\xBF\xBF", 3},
+        {"\xF0\x90\x80\x80", 4},
+        {"\xED\xB0\x80", 3},
+        {"\xF4\x8F\xBF\xBF", 4},
+        {"\xED\xAF\xBF\xF0\x9F\x98\x80", 7},
+    };
 
-    /* Test single token */
-    for (int i = 0; i < sizeof(pos)/sizeof(pos[0]); ++i) {
-        if (ftab->func(pos[i].data, pos[i].len) != 0) {
-            printf("FAILED positive test: ");
-            print_test(pos[i].data, pos[i].len);
-            return -1;
+    /* negative tests */
+    static const struct test neg[] = {
+        {"\xED\xA0\x80\xED\xB0\x80", 6},
+        {"\xED\xAF\xBF\xED\xBF\xBF", 6},
+        {"\xED\xA0\x80\xED\xA0\x80\xED\xB0\x80", 9},
+        {"\xED\xA0\x80\xED\xB0", 5},
+        {"\xED\xA0", 2},
+        {"\xED\xC0\x80", 3},
+        {"\xC0\x80", 2},
+        {"\xE0\x9F\x80", 3},
+        {"\xF0\x8F\x80\x80", 4},
+        {"\xF4\x90\x80\x80", 4},
+        {"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xED\xA0\x80" \
+         "\xED\xB0\x80\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+         32},
+        {"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" \
+         "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xED\xA0\x80" \
+         "\xED\xB0\x80", 35},
+    };
+#pragma GCC diagnostic pop
+
+    return test_tokens(ftab, pos, sizeof(pos)/sizeof(pos[0]),
+                       neg, sizeof(neg)/sizeof(neg[0]));
+}
+
+/* Code point rejected by policy, see UTF8_POLICY_* in utf8range.h */
+static int ref_reject(unsigned int u, unsigned int policy)
+{
+    const int ctrl = (u < 0x20 && u != 0x09 && u != 0x0A && u != 0x0D) ||
+                     u == 0x7F;
+    const int nonchar = (u >= 0xFDD0 && u <= 0xFDEF) ||
+                        (u & 0xFFFF) == 0xFFFE || (u & 0xFFFF) == 0xFFFF;
+    const int private = (u >= 0xE000 && u <= 0xF8FF) ||
+                        (u >= 0xF0000 && u <= 0x10FFFF);
+
+    return ((policy & UTF8_POLICY_NUL) && u == 0) ||
+           ((policy & UTF8_POLICY_CONTROL) && ctrl) ||
+           ((policy & UTF8_POLICY_C1) && u >= 0x80 && u <= 0x9F) ||
+           ((policy & UTF8_POLICY_NONCHAR) && nonchar) ||
+           ((policy & UTF8_POLICY_PRIVATE) && private);
+}
+
+/*
+ * Reference validator decoding code points by definition, independent of
+ * all kernels under test. Code points are also checked against policy.
+ * Return 0 - success, >0 - index(1 based) of first error char
+ */
+static int ref_utf8_policy(const unsigned char *data, int len,
+                           unsigned int policy)
+{
+    int i = 0;
+
+    while (i < len) {
+        const unsigned char byte1 = data[i];
+        unsigned int u, min;
+        int trail;
+
+        if (byte1 <= 0x7F) {
+            if (ref_reject(byte1, policy))
+                return i + 1;
+            ++i;
+            continue;
+        } else if ((byte1 & 0xE0) == 0xC0) {
+            trail = 1, u = byte1 & 0x1F, min = 0x80;
+        } else if ((byte1 & 0xF0) == 0xE0) {
+            trail = 2, u = byte1 & 0x0F, min = 0x800;
+        } else if ((byte1 & 0xF8) == 0xF0) {
+            trail = 3, u = byte1 & 0x07, min = 0x10000;
+        } else {
+            return i + 1;
         }
-    }
-    for (int i = 0; i < sizeof(neg)/sizeof(neg[0]); ++i) {
-        if (ftab->func(neg[i].data, neg[i].len) == 0) {
-            printf("FAILED negitive test: ");
-            print_test(neg[i].data, neg[i].len);
-            return -1;
+
+        if (i + trail >= len)
+            return i + 1;
+        for (int j = 1; j <= trail; ++j) {
+            if ((data[i+j] & 0xC0) != 0x80)
+                return i + 1;
+            u = (u << 6) | (data[i+j] & 0x3F);
         }
+        /* Overlong, surrogate or out of range */
+        if (u < min || u > 0x10FFFF || (u >= 0xD800 && u <= 0xDFFF))
+            return i + 1;
+        if (ref_reject(u, policy))
+            return i + 1;
+
+        i += trail + 1;
     }
 
-    /* Test shifted buffer to cover 1k length */
-    /* buffer size must be greater than 1024 + 16 + max(test string length) */
-    const int max_size = 1024*2;
-    uint64_t buf64[max_size/8 + 2];
-    /* Offset 8 bytes by 1 byte */
-    unsigned char *buf = ((unsigned char *)buf64) + 1;
-    int buf_len;
+    return 0;
+}
 
-    for (int i = 0; i < sizeof(pos)/sizeof(pos[0]); ++i) {
-        /* Positive test: shift 16 bytes, validate each shift */
-        prepare_test_buf(buf, pos, sizeof(pos)/sizeof(pos[0]), i);
-        buf_len = 1024;
-        for (int j = 0; j < 16; ++j) {
-            if (ftab->func(buf, buf_len) != 0) {
-                printf("FAILED positive test: ");
-                print_test(buf, buf_len);
-                return -1;
-            }
-            for (int k = buf_len; k >= 1; --k)
-                buf[k] = buf[k-1];
-            buf[0] = '\x55';
-            ++buf_len;
+static int ref_utf8(const unsigned char *data, int len)
+{
+    return ref_utf8_policy(data, len, 0);
+}
+
+/*
+ * Reference CESU-8 (mutf8 = 0) and Modified UTF-8 (mutf8 = 1) validator,
+ * surrogates are decoded as code points. A surrogate pair is one char.
+ * Return 0 - success, >0 - index(1 based) of first error char
+ */
+static int ref_cesu8_mutf8(const unsigned char *data, int len, int mutf8)
+{
+    int i = 0;
+    int high = 0;   /* index(1 based) of high surrogate waiting for pair */
+
+    while (i < len) {
+        const unsigned char byte1 = data[i];
+        unsigned int u, min;
+        int trail;
+
+        if (byte1 <= 0x7F) {
+            trail = 0, u = byte1, min = mutf8;
+        } else if ((byte1 & 0xE0) == 0xC0) {
+            trail = 1, u = byte1 & 0x1F, min = 0x80;
+        } else if ((byte1 & 0xF0) == 0xE0) {
+            trail = 2, u = byte1 & 0x0F, min = 0x800;
+        } else {
+            return high ? high : i + 1;
         }
 
-        /* Negative test: trunk last non ascii */
-        while (buf_len >= 1 && buf[buf_len-1] <= 0x7F)
-            --buf_len;
-        if (buf_len && ftab->func(buf, buf_len-1) == 0) {
-            printf("FAILED negitive test: ");
-            print_test(buf, buf_len);
-            return -1;
+        if (i + trail >= len)
+            return high ? high : i + 1;
+        for (int j = 1; j <= trail; ++j) {
+            if ((data[i+j] & 0xC0) != 0x80)
+                return high ? high : i + 1;
+            u = (u << 6) | (data[i+j] & 0x3F);
         }
-    }
+        /* MUTF-8 encodes U+0000 as C0 80 */
+        if (mutf8 && trail == 1 && u == 0)
+            min = 0;
+        if (u < min)
+            return high ? high : i + 1;
 
-    /* Negative test */
-    for (int i = 0; i < sizeof(neg)/sizeof(neg[0]); ++i) {
-        /* Append one error token, shift 16 bytes, validate each shift */
-        int pos_idx = i % (sizeof(pos)/sizeof(pos[0]));
-        prepare_test_buf(buf, pos, sizeof(pos)/sizeof(pos[0]), pos_idx);
-        memcpy(buf+1024, neg[i].data, neg[i].len);
-        buf_len = 1024 + neg[i].len;
-        for (int j = 0; j < 16; ++j) {
-            if (ftab->func(buf, buf_len) == 0) {
-                printf("FAILED negative test: ");
-                print_test(buf, buf_len);
-                return -1;
-            }
-            for (int k = buf_len; k >= 1; --k)
-                buf[k] = buf[k-1];
-            buf[0] = '\x66';
-            ++buf_len;
+        if (high) {
+            if (u < 0xDC00 || u > 0xDFFF)
+                return high;
+            high = 0;
+        } else if (u >= 0xD800 && u <= 0xDBFF) {
+            high = i + 1;
+        } else if (u >= 0xDC00 && u <= 0xDFFF) {
+            return i + 1;
         }
+
+        i += trail + 1;
     }
 
-    return 0;
+    return high;
 }
 
-static int test(const unsigned char *data, int len, const struct ftab *ftab)
+static int ref_cesu8(const unsigned char *data, int len)
 {
-    int ret_standard = ftab->func(data, len);
-    int ret_manual = test_manual(ftab);
-    printf("%s\n", ftab->name);
-    printf("standard test: %s\n", ret_standard ? "FAIL" : "pass");
-    printf("manual test: %s\n", ret_manual ? "FAIL" : "pass");
+    return ref_cesu8_mutf8(data, len, 0);
+}
 
-    return ret_standard | ret_manual;
+static int ref_mutf8(const unsigned char *data, int len)
+{
+    return ref_cesu8_mutf8(data, len, 1);
 }
 
-static int bench(const unsigned char *data, int len, const struct ftab *ftab)
+/*
+ * Reference WTF-8 validator: UTF-8 accepting surrogate code points, except
+ * a high surrogate followed by a low surrogate
+ * Return 0 - success, >0 - index(1 based) of first error char, or of the
+ * high surrogate of a pair
+ */
+static int ref_wtf8(const unsigned char *data, int len)
 {
-    const int loops = 1024*1024*1024/len;
-    int ret = 0;
-    double time, size;
-    struct timeval tv1, tv2;
+    int i = 0;
+    int high = 0;   /* index(1 based) of previous char if high surrogate */
 
-    fprintf(stderr, "bench %s... ", ftab->name);
-    gettimeofday(&tv1, 0);
-    for (int i = 0; i < loops; ++i)
-        ret |= ftab->func(data, len);
-    gettimeofday(&tv2, 0);
-    printf("%s\n", ret?"FAIL":"pass");
+    while (i < len) {
+        const unsigned char byte1 = data[i];
+        unsigned int u, min;
+        int trail;
 
-    time = tv2.tv_usec - tv1.tv_usec;
-    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
-    size = ((double)len * loops) / (1024*1024);
-    printf("time: %.4f s\n", time);
-    printf("data: %.0f MB\n", size);
-    printf("BW: %.2f MB/s\n", size / time);
+        if (byte1 <= 0x7F) {
+            trail = 0, u = byte1, min = 0;
+        } else if ((byte1 & 0xE0) == 0xC0) {
+            trail = 1, u = byte1 & 0x1F, min = 0x80;
+        } else if ((byte1 & 0xF0) == 0xE0) {
+            trail = 2, u = byte1 & 0x0F, min = 0x800;
+        } else if ((byte1 & 0xF8) == 0xF0) {
+            trail = 3, u = byte1 & 0x07, min = 0x10000;
+        } else {
+            return i + 1;
+        }
+
+        if (i + trail >= len)
+            return i + 1;
+        for (int j = 1; j <= trail; ++j) {
+            if ((data[i+j] & 0xC0) != 0x80)
+                return i + 1;
+            u = (u << 6) | (data[i+j] & 0x3F);
+        }
+        if (u < min || u > 0x10FFFF)
+            return i + 1;
+        if (high && u >= 0xDC00 && u <= 0xDFFF)
+            return high;
+
+        high = (u >= 0xD800 && u <= 0xDBFF) ? i + 1 : 0;
+        i += trail + 1;
+    }
 
     return 0;
 }
 
-static void usage(const char *bin)
-{
-    printf("Usage:\n");
-    printf("%s test  [alg]      ==> test all or one algorithm\n", bin);
-    printf("%s bench [alg]      ==> benchmark all or one algorithm\n", bin);
-    printf("%s bench size NUM   ==> benchmark with specific buffer size\n", bin);
-    printf("alg = ");
-    for (int i = 0; i < sizeof(ftab)/sizeof(ftab[0]); ++i)
-        printf("%s ", ftab[i].name);
-    printf("\nNUM = buffer size in bytes, 1 ~ 67108864(64M)\n");
-}
+/*
+ * Place one sequence padded with ascii at offset 0 ~ 64 of aligned and
+ * unaligned buffers, and check buffers ending right after the sequence
+ * (tail and lookahead handling), at the same distance after it as before
+ * it, and spanning 3 blocks of 32 bytes (block seams).
+ * Check returns 0 on success, -1 on error after printing the failure.
+ */
+#define BOUNDARY_MAX_OFF    64
+#define BOUNDARY_LEN        97
 
-int main(int argc, char *argv[])
+typedef int (*check_func)(const void *arg, const unsigned char *buf, int len);
+
+static int test_boundary_seq(check_func check, const void *arg,
+                             const unsigned char *seq, int seq_len)
 {
-    int len = 0;
-    unsigned char *data;
-    const char *alg = NULL;
-    int (*tb)(const unsigned char *data, int len, const struct ftab *ftab);
+    uint64_t buf64[(BOUNDARY_LEN + 1 + 63) / 8] __attribute__((aligned(64)));
 
-    tb = NULL;
-    if (argc >= 2) {
-        if (strcmp(argv[1], "test") == 0)
-            tb = test;
-        else if (strcmp(argv[1], "bench") == 0)
-            tb = bench;
-        if (argc >= 3) {
-            alg = argv[2];
-            if (strcmp(alg, "size") == 0) {
-                if (argc < 4) {
-                    tb = NULL;
-                } else {
-                    alg = NULL;
-                    len = atoi(argv[3]);
-                    if (len <= 0 || len > 67108864) {
-                        printf("Buffer size error!\n\n");
-                        tb = NULL;
-                    }
-                }
+    for (int align = 0; align <= 1; ++align) {
+        unsigned char *buf = (unsigned char *)buf64 + align;
+
+        for (int off = 0; off <= BOUNDARY_MAX_OFF; ++off) {
+            memset(buf, '\x55', BOUNDARY_LEN);
+            memcpy(buf+off, seq, seq_len);
+
+            if (check(arg, buf, off + seq_len) ||
+                    check(arg, buf, BOUNDARY_LEN - off) ||
+                    check(arg, buf, BOUNDARY_LEN)) {
+                printf("FAILED at align=%d, off=%d\n", align, off);
+                return -1;
             }
         }
     }
 
-    if (tb == NULL) {
-        usage(argv[0]);
-        return 1;
+    return 0;
+}
+
+/* Validation kernel and its reference */
+struct validate_arg {
+    const struct ftab *ftab;
+    int (*ref_func)(const unsigned char *, int);
+};
+
+static int test_validate_buf(const void *arg, const unsigned char *buf,
+                             int len)
+{
+    const struct validate_arg *a = arg;
+    const int ref = a->ref_func(buf, len);
+    const int ret = a->ftab->func(buf, len);
+
+    /* Kernels report -1 or first error index on failure */
+    if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref)) {
+        printf("FAILED boundary test(%d:%d, len=%d): ", ret, ref, len);
+        print_test(buf, len);
+        return -1;
     }
 
-    /* Load UTF8 test buffer */
-    if (len)
-        data = load_test_buf(len);
-    else
-        data = load_test_file(&len);
+    return 0;
+}
 
-    int ret = 0;
+/* Return 0 on success, -1 on error */
+static int test_boundary(const struct ftab *ftab,
+                         int (*ref_func)(const unsigned char *, int))
+{
+    /* Second Bytes around all range boundaries */
+    static const unsigned char second[] = {
+        0x00, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC2, 0xF4, 0xFF,
+    };
+    /* Third and Fourth Bytes */
+    static const unsigned char trail[] = { 0x80, 0xBF, 0x7F, 0xC0 };
+
+    const struct validate_arg arg = { ftab, ref_func };
+    unsigned char seq[4];
+
+    for (int byte1 = 0; byte1 <= 0xFF; ++byte1) {
+        const int seq_len = byte1 < 0xC0 ? 1 : byte1 < 0xE0 ? 2 :
+                            byte1 < 0xF0 ? 3 : 4;
+
+        seq[0] = byte1;
+        /* Single byte, or truncated sequence */
+        if (test_boundary_seq(test_validate_buf, &arg, seq, 1))
+            return -1;
+        if (seq_len == 1)
+            continue;
+
+        /* Enumerate all Second Bytes after special First Bytes */
+        const int special = byte1 == 0xE0 || byte1 == 0xED ||
+                            byte1 == 0xF0 || byte1 == 0xF4;
+        const int n2 = special ? 256 : sizeof(second);
+
+        for (int i2 = 0; i2 < n2; ++i2) {
+            seq[1] = special ? i2 : second[i2];
+
+            /* Complete or truncated sequences */
+            for (int len = 2; len <= seq_len; ++len) {
+                const int ntrail = len == 2 ? 1 : sizeof(trail);
+                for (int i3 = 0; i3 < ntrail; ++i3) {
+                    seq[2] = seq[3] = trail[i3];
+                    if (test_boundary_seq(test_validate_buf, &arg, seq, len))
+                        return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Place sequence at every position of strings 0 ~ 130 bytes long, ending
+ * with the NUL passed in. Bytes before string start and after NUL must be
+ * ignored by kernels.
+ */
+#define CSTR_MAX_LEN    130
+
+static int test_cstr_nul(const struct ftab_cstr *ftab, unsigned char *nul)
+{
+    static const char *seqs[] = {
+        "", "\xC2\x80", "\xE0\xA0\x80", "\xF0\x90\x80\x80",
+        "\xF4\x8F\xBF\xBF", "\xC2", "\xE0\xA0", "\xF0\x90\x80",
+        "\x80", "\xC0\x80", "\xE0\x80\x80", "\xED\xA0\x80",
+        "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF",
+    };
+
+    for (int len = 0; len <= CSTR_MAX_LEN; ++len) {
+        unsigned char *str = nul - len;
+
+        for (int s = 0; s < sizeof(seqs)/sizeof(seqs[0]); ++s) {
+            const int seq_len = strlen(seqs[s]);
+
+            for (int pos = 0; pos + seq_len <= len; ++pos) {
+                size_t len2 = 0;
+                int ref, ret;
+
+                memset(str, 'a', len);
+                memcpy(str + pos, seqs[s], seq_len);
+                ref = ref_utf8(str, len);
+                ret = ftab->func((const char *)str, &len2);
+
+                if (len2 != len || (ret == 0) != (ref == 0) ||
+                        (ret > 0 && ret != ref)) {
+                    printf("FAILED cstr test: returns %d, len %zu, "
+                           "expects %d, len %d\n", ret, len2, ref, len);
+                    print_test(str, len);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * NUL is 0, 1 or 35 bytes before an inaccessible page, all other bytes of
+ * the page are 00 or F0
+ */
+static int test_cstr(const struct ftab_cstr *ftab)
+{
+    static const int tails[] = { 0, 1, 35 };
+    const long page = sysconf(_SC_PAGESIZE);
+    unsigned char *pages = mmap(NULL, page * 2, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    int ret = 0;
+
+    if (pages == MAP_FAILED || mprotect(pages + page, page, PROT_NONE)) {
+        printf("Failed to map test pages!\n");
+        return -1;
+    }
+
+    for (int fill = 0; fill <= 0xF0 && !ret; fill += 0xF0) {
+        for (int i = 0; i < sizeof(tails)/sizeof(tails[0]) && !ret; ++i) {
+            unsigned char *nul = pages + page - 1 - tails[i];
+
+            memset(pages, fill, page);
+            *nul = 0;
+            ret = test_cstr_nul(ftab, nul);
+        }
+    }
+
+    munmap(pages, page * 2);
+    return ret;
+}
+
+struct policy_arg {
+    const struct ftab_policy *ftab;
+    unsigned int policy;
+};
+
+static int test_policy_buf(const void *arg, const unsigned char *buf, int len)
+{
+    const struct policy_arg *a = arg;
+    const int ref = ref_utf8_policy(buf, len, a->policy);
+    const int ret = a->ftab->func(buf, len, a->policy);
+
+    if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref)) {
+        printf("FAILED policy test(%d:%d, policy=%02x, len=%d): ",
+               ret, ref, a->policy, len);
+        print_test(buf, len);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Validate one sequence at block seams with all policy combinations */
+static int test_policy_seq(const struct ftab_policy *ftab,
+                           const unsigned char *seq, int seq_len)
+{
+    for (unsigned int policy = 0; policy < 32; ++policy) {
+        const struct policy_arg arg = { ftab, policy };
+
+        if (test_boundary_seq(test_policy_buf, &arg, seq, seq_len))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Encode code point, return bytes */
+static int encode_utf8(unsigned int u, unsigned char *p)
+{
+    if (u < 0x80) {
+        p[0] = u;
+        return 1;
+    } else if (u < 0x800) {
+        p[0] = 0xC0 | (u >> 6);
+        p[1] = 0x80 | (u & 0x3F);
+        return 2;
+    } else if (u < 0x10000) {
+        p[0] = 0xE0 | (u >> 12);
+        p[1] = 0x80 | ((u >> 6) & 0x3F);
+        p[2] = 0x80 | (u & 0x3F);
+        return 3;
+    }
+    p[0] = 0xF0 | (u >> 18);
+    p[1] = 0x80 | ((u >> 12) & 0x3F);
+    p[2] = 0x80 | ((u >> 6) & 0x3F);
+    p[3] = 0x80 | (u & 0x3F);
+    return 4;
+}
+
+/* Return 0 on success, -1 on error */
+static int test_policy(const struct ftab_policy *ftab)
+{
+    /* Code points around boundaries of all policies */
+    static const unsigned int cps[] = {
+        0x00, 0x01, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x1F, 0x20,
+        0x19, 0x1A, 0x1D, 0x29, 0x7E, 0x7F, 0x80, 0x9F, 0xA0, 0xFF, 0x7FF,
+        0x800, 0xD7FF, 0xDFFF + 1, 0xE000, 0xF8FF, 0xF900, 0xFDCF, 0xFDD0,
+        0xFDEF, 0xFDF0, 0xFEFF, 0xFFFD, 0xFFFE, 0xFFFF, 0x10000, 0x1FFFD,
+        0x1FFFE, 0x1FFFF, 0x2FFFE, 0x3FFFF, 0x4FFFE, 0x4EFFF, 0x4FEFF,
+        0xEFFFD, 0xEFFFF, 0xF0000, 0xFFFFF, 0x100000, 0x10FFFD, 0x10FFFF,
+    };
+    /* Ill-formed or truncated sequences */
+    static const char *seqs[] = {
+        "\xC2", "\xC1\xBF", "\xEF\xBF", "\xEF\xB7", "\xED\xA0\x80",
+        "\xEE\x80", "\xF3\xB0\x80", "\xF4\x90\x80\x80", "\xF0\x8F\xBF\xBF",
+        "\xEF\xEF\xBF\xBF", "\xC2\xC2\x80", "\xF3\xEF\xBF\xBE",
+    };
+
+    unsigned char seq[4];
+
+    for (int i = 0; i < sizeof(cps)/sizeof(cps[0]); ++i) {
+        const int seq_len = encode_utf8(cps[i], seq);
+
+        if (test_policy_seq(ftab, seq, seq_len))
+            return -1;
+    }
+    for (int i = 0; i < sizeof(seqs)/sizeof(seqs[0]); ++i) {
+        if (test_policy_seq(ftab, (const unsigned char *)seqs[i],
+                            strlen(seqs[i])))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Chars of well-formed string, by length of each sequence */
+static size_t ref_count(const unsigned char *data, int len)
+{
+    size_t n = 0;
+
+    for (int i = 0; i < len; ++n) {
+        const unsigned char byte1 = data[i];
+        i += byte1 < 0x80 ? 1 : byte1 < 0xE0 ? 2 : byte1 < 0xF0 ? 3 : 4;
+    }
+
+    return n;
+}
+
+/* Count must be exact on success, and on failure if kernel reports index */
+static int test_count_buf(const void *f, const unsigned char *buf, int len)
+{
+    const struct ftab_count *ftab = f;
+    const int ref = ref_utf8(buf, len);
+    const size_t ref_n = ref_count(buf, ref ? ref - 1 : len);
+    size_t n = -1;
+    const int ret = ftab->func(buf, len, &n);
+
+    if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref) ||
+            (ret >= 0 && n != ref_n)) {
+        printf("FAILED count test(%d:%d, count=%zu:%zu, len=%d)\n",
+               ret, ref, n, ref_n, len);
+        if (len <= BOUNDARY_LEN)
+            print_test(buf, len);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Run check on code points and ill-formed sequences at block boundaries,
+ * then on a long buffer of mostly ascii. Return 0 on success, -1 on error
+ */
+static int test_char_bufs(check_func check, const void *ftab)
+{
+    static const unsigned int cps[] = {
+        0x00, 0x7F, 0x80, 0x7FF, 0x800, 0xFFFF, 0x10000, 0x10FFFF,
+    };
+    static const char *seqs[] = {
+        "\xC2", "\x80", "\xE0\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80",
+        "\xF0\x90\x80", "\xC2\x80\xC2",
+    };
+    const int ncps = sizeof(cps)/sizeof(cps[0]);
+    const int nseqs = sizeof(seqs)/sizeof(seqs[0]);
+    unsigned char seq[4];
+
+    for (int k = 0; k < ncps + nseqs; ++k) {
+        const unsigned char *p = k < ncps ?
+            seq : (const unsigned char *)seqs[k - ncps];
+        const int seq_len = k < ncps ?
+            encode_utf8(cps[k], seq) : strlen(seqs[k - ncps]);
+
+        if (test_boundary_seq(check, ftab, p, seq_len))
+            return -1;
+    }
+
+    /* Long enough to overflow 8-bit per lane counters */
+    const int len = 3 * 255 * 64 + 37;
+    unsigned char *buf = malloc(len + 4);
+    int n = 0, ret = 0;
+
+    for (int k = 0; n < len; ++k) {
+        if (k % 16 == 15)
+            n += encode_utf8(cps[k / 16 % ncps], buf + n);
+        else
+            buf[n++] = 'a' + k % 26;
+    }
+    for (int i = 0; i < 8 && ret == 0; ++i)
+        ret = check(ftab, buf, len - i);
+    buf[len - 30] = 0xFF;
+    if (ret == 0)
+        ret = check(ftab, buf, len);
+
+    /* 3 bytes chars after 0~3 ascii, chars at all vector ends, all lengths */
+    for (int pre = 0; pre < 4 && ret == 0; ++pre) {
+        memset(buf, 'a', pre);
+        for (n = pre; n + 3 <= 1024; )
+            n += encode_utf8(0x4E2D, buf + n);
+        for (int i = 0; i <= n && ret == 0; ++i)
+            ret = check(ftab, buf, i);
+    }
+
+    free(buf);
+    return ret;
+}
+
+static int test_count(const struct ftab_count *ftab)
+{
+    return test_char_bufs(test_count_buf, ftab);
+}
+
+/*
+ * Index entries must match char offsets on success, and before first error
+ * if kernel reports error index. Offset of every char is looked up.
+ */
+static int test_index_buf(const void *f, const unsigned char *buf, int len)
+{
+    const struct ftab_index *ftab = f;
+    const int ref = ref_utf8(buf, len);
+    const int valid = ref ? ref - 1 : len;
+    int *offsets = malloc((len + 1) * sizeof(int));
+    int *index = malloc((UTF8_INDEX_SIZE(len) + 1) * sizeof(int));
+    size_t ref_n = 0, n = -1;
+    int err = 0;
+
+    /* Byte offset of every char, followed by len */
+    for (int i = 0; i < valid; ++ref_n) {
+        offsets[ref_n] = i;
+        const unsigned char byte1 = buf[i];
+        i += byte1 < 0x80 ? 1 : byte1 < 0xE0 ? 2 : byte1 < 0xF0 ? 3 : 4;
+    }
+    offsets[ref_n] = valid;
+
+    const int ret = ftab->build(buf, len, index, &n);
+    if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref) ||
+            (ret >= 0 && n != ref_n)) {
+        printf("FAILED index test(%d:%d, count=%zu:%zu, len=%d)\n",
+               ret, ref, n, ref_n, len);
+        err = -1;
+    }
+    for (size_t i = 0; err == 0 && ret >= 0 && i < ref_n;
+            i += UTF8_INDEX_STRIDE) {
+        if (index[i / UTF8_INDEX_STRIDE] != offsets[i]) {
+            printf("FAILED index test(char %zu, offset=%d:%d, len=%d)\n",
+                   i, index[i / UTF8_INDEX_STRIDE], offsets[i], len);
+            err = -1;
+        }
+    }
+    for (size_t k = 0; err == 0 && ret == 0 && k <= n + 1; ++k) {
+        const int off = ftab->offset(buf, len, index, n, k);
+        const int ref_off = k <= n ? offsets[k] : -1;
+
+        if (off != ref_off) {
+            printf("FAILED index offset(char %zu, offset=%d:%d, len=%d)\n",
+                   k, off, ref_off, len);
+            err = -1;
+        }
+    }
+
+    if (err && len <= BOUNDARY_LEN)
+        print_test(buf, len);
+    free(offsets);
+    free(index);
+    return err;
+}
+
+static int test_index(const struct ftab_index *ftab)
+{
+    return test_char_bufs(test_index_buf, ftab);
+}
+
+/* Skip k chars of valid prefix for every k */
+static int test_skip_buf(const void *f, const unsigned char *buf, int len)
+{
+    const struct ftab_skip *ftab = f;
+    const int ref = ref_utf8(buf, len);
+    const int valid = ref ? ref - 1 : len;
+    size_t k = 0;
+
+    for (int i = 0; i <= valid; ++k) {
+        const int off = ftab->func(buf, valid, k);
+
+        if (off != i) {
+            printf("FAILED skip test(char %zu, offset=%d:%d, len=%d)\n",
+                   k, off, i, valid);
+            return -1;
+        }
+        if (i == valid)
+            break;
+        const unsigned char byte1 = buf[i];
+        i += byte1 < 0x80 ? 1 : byte1 < 0xE0 ? 2 : byte1 < 0xF0 ? 3 : 4;
+    }
+    if (ftab->func(buf, valid, k + 1) != -1) {
+        printf("FAILED skip test(char %zu beyond end, len=%d)\n",
+               k + 1, valid);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_skip(const struct ftab_skip *ftab)
+{
+    return test_char_bufs(test_skip_buf, ftab);
+}
+
+/* Escape mask and count must match scalar scan of valid prefix */
+static int test_json_buf(const void *f, const unsigned char *buf, int len)
+{
+    const struct ftab_json *ftab = f;
+    const int ref = ref_utf8(buf, len);
+    const int valid = ref ? ref - 1 : len;
+    const int words = UTF8_JSON_MASK_SIZE(len);
+    uint64_t *mask = malloc(words * sizeof(uint64_t));
+    uint64_t *ref_mask = calloc(words, sizeof(uint64_t));
+    size_t n = -1, ref_n = 0;
+    int err = 0;
+
+    for (int i = 0; i < valid; ++i) {
+        if (buf[i] < 0x20 || buf[i] == '"' || buf[i] == '\\') {
+            ref_mask[i / 64] |= 1ULL << (i % 64);
+            ++ref_n;
+        }
+    }
+
+    /* Garbage in mask buffer, all words must be written */
+    memset(mask, 0xA5, words * sizeof(uint64_t));
+    const int ret = ftab->func(buf, len, mask, &n);
+    if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref) ||
+            (ret >= 0 && (n != ref_n ||
+             memcmp(mask, ref_mask, UTF8_JSON_MASK_SIZE(valid) * 8)))) {
+        printf("FAILED json test(%d:%d, escapes=%zu:%zu, len=%d)\n",
+               ret, ref, n, ref_n, len);
+        if (len <= BOUNDARY_LEN)
+            print_test(buf, len);
+        err = -1;
+    }
+
+    free(mask);
+    free(ref_mask);
+    return err;
+}
+
+/* Escapes and ill-formed sequences at block boundaries, and a long string */
+static int test_json(const struct ftab_json *ftab)
+{
+    static const char *seqs[] = {
+        "\"", "\\", "\x1F", "\x20", "\x7F", "\x01\"\\", "\xC2\x80\"",
+        "\xE4\xB8\xAD\x0A", "\xC2", "\"\xC2", "\xF0\x9F\x98\x80\\\xE0\x80",
+    };
+
+    for (int k = 0; k < sizeof(seqs)/sizeof(seqs[0]); ++k) {
+        if (test_boundary_seq(test_json_buf, ftab,
+                              (const unsigned char *)seqs[k],
+                              strlen(seqs[k])))
+            return -1;
+    }
+
+    /* Escapes of all kinds spread over 8K, all tail lengths */
+    const int len = 8192 + 64;
+    unsigned char *buf = malloc(len);
+    int ret = 0;
+
+    for (int i = 0; i < len; ++i)
+        buf[i] = i % 61 == 0 ? '"' : i % 67 == 0 ? '\\' :
+                 i % 71 == 0 ? (unsigned char)(i % 32) : 'a' + i % 26;
+    for (int i = 0; i <= 64 && ret == 0; ++i)
+        ret = test_json_buf(ftab, buf, len - i);
+
+    free(buf);
+    return ret;
+}
+
+/*
+ * Lines and per line errors must match reference, also when ends[] is too
+ * short and caller continues after last line found
+ */
+static int test_lines_buf(const struct ftab_lines *ftab,
+                          const unsigned char *buf, int len,
+                          const char *delims, int max_lines)
+{
+    int *ref_ends = malloc((len + 1) * sizeof(int));
+    int *ref_errors = malloc((len + 1) * sizeof(int));
+    int *ends = malloc((len + 1) * sizeof(int));
+    int *errors = malloc((len + 1) * sizeof(int));
+    int ref_n = 0, n = 0, err = 0;
+
+    for (int i = 0, start = 0; i <= len; ++i) {
+        if (i < len ? (buf[i] && strchr(delims, buf[i])) : start < len) {
+            ref_ends[ref_n] = i;
+            ref_errors[ref_n++] = ref_utf8(buf + start, i - start);
+            start = i + 1;
+        }
+    }
+
+    for (int start = 0; start < len; ) {
+        const int k = ftab->func(buf + start, len - start, delims,
+                                 ends + n, errors + n, max_lines);
+
+        for (int i = n; i < n + k; ++i)
+            ends[i] += start;
+        n += k;
+        if (k < max_lines || n > ref_n)
+            break;
+        start = ends[n-1] + 1;
+    }
+
+    if (n != ref_n) {
+        printf("FAILED lines test(lines=%d:%d, len=%d)\n", n, ref_n, len);
+        err = -1;
+    }
+    for (int i = 0; err == 0 && i < n; ++i) {
+        if (ends[i] != ref_ends[i] || errors[i] != ref_errors[i]) {
+            printf("FAILED lines test(line %d, end=%d:%d, error=%d:%d, "
+                   "len=%d)\n", i, ends[i], ref_ends[i], errors[i],
+                   ref_errors[i], len);
+            err = -1;
+        }
+    }
+
+    if (err && len <= BOUNDARY_LEN)
+        print_test(buf, len);
+    free(ref_ends);
+    free(ref_errors);
+    free(ends);
+    free(errors);
+    return err;
+}
+
+struct lines_arg {
+    const struct ftab_lines *ftab;
+    const char *delims;
+};
+
+/* All lines at once, and one line per call */
+static int test_lines_seq_buf(const void *arg, const unsigned char *buf,
+                              int len)
+{
+    const struct lines_arg *a = arg;
+
+    return test_lines_buf(a->ftab, buf, len, a->delims, 1000) ||
+           test_lines_buf(a->ftab, buf, len, a->delims, 1) ? -1 : 0;
+}
+
+static int test_lines(const struct ftab_lines *ftab)
+{
+    static const char *delims[] = { "\n", "\n\r,;\t|\x01\x7F" };
+    static const char *seqs[] = {
+        "\n", "\n\n", "\xC2\n", "\xE4\xB8\n\xAD", "\xF0\x9F\x98\x80\n",
+        "\n\x80", "\xED\xA0\x80\n\xC2\x80", ",\xC2;", "\xC2\x80\r\n\xFF",
+        "\x7F\xE0\x80\x01", "\xF4\x90\x80\x80|",
+    };
+
+    for (int d = 0; d < sizeof(delims)/sizeof(delims[0]); ++d) {
+        const struct lines_arg arg = { ftab, delims[d] };
+
+        for (int k = 0; k < sizeof(seqs)/sizeof(seqs[0]); ++k) {
+            if (test_boundary_seq(test_lines_seq_buf, &arg,
+                                  (const unsigned char *)seqs[k],
+                                  strlen(seqs[k])))
+                return -1;
+        }
+    }
+
+    /* Short and long lines, some ill-formed */
+    const int len = 16384;
+    unsigned char *buf = malloc(len);
+    unsigned int r = 1;
+    int ret = 0;
+
+    for (int i = 0; i < len; ) {
+        r = r * 1103515245 + 12345;
+        const int line = (r >> 16) % 8 == 0 ? (r >> 8) % 1000 : (r >> 8) % 40;
+
+        for (int j = 0; j < line && i + 4 < len; ++j) {
+            r = r * 1103515245 + 12345;
+            if ((r >> 16) % 500 == 0)
+                buf[i++] = 0x80 + (r >> 8) % 0x80;
+            else if ((r >> 16) % 4 == 0)
+                i += encode_utf8(0x80 + (r >> 8) % 0x10000, buf + i);
+            else
+                buf[i++] = 'a' + (r >> 8) % 26;
+        }
+        while (i < len && (buf[i-1] & 0xC0) == 0x80 && (r & 1))
+            buf[i++] = 'z';
+        if (i < len)
+            buf[i++] = (r >> 20) % 2 ? '\n' : '\r';
+    }
+    for (int i = 0; i < 16 && ret == 0; ++i) {
+        ret = test_lines_buf(ftab, buf, len - i, delims[i % 2], 100000) ||
+              test_lines_buf(ftab, buf, len - i, delims[i % 2], 7 + i * 5);
+    }
+
+    free(buf);
+    return ret;
+}
+
+/* utf8_truncate(), utf8_truncate_chars() and utf8_split() */
+static int test_truncate(void)
+{
+    static const unsigned int cps[] = { 0x41, 0x3B1, 0x4E2D, 0x1F600 };
+    unsigned char buf[256 + 1];
+    int len = 0, chars = 0;
+
+    for (int k = 0; len + 4 < sizeof(buf); ++k, ++chars)
+        len += encode_utf8(cps[k * 7 % 11 % 4], buf + len);
+
+    for (int max = -1; max <= len + 1; ++max) {
+        const int n = utf8_truncate(buf, len, max);
+        int ref = max < 0 ? 0 : max > len ? len : max;
+
+        while (ref < len && (buf[ref] & 0xC0) == 0x80)
+            --ref;
+        if (n != ref) {
+            printf("FAILED truncate test(max=%d, %d:%d)\n", max, n, ref);
+            return -1;
+        }
+    }
+
+    for (int max = 0, ref = 0; max <= chars + 1; ++max) {
+        const int n = utf8_truncate_chars(buf, len, max);
+
+        if (n != ref) {
+            printf("FAILED truncate chars test(max=%d, %d:%d)\n",
+                   max, n, ref);
+            return -1;
+        }
+        while (ref < len && (buf[++ref] & 0xC0) == 0x80)
+            ;
+    }
+
+    /* Leading Continuation Bytes, walk back must stop at data */
+    static const unsigned char conts[] = "\x80\x80\x80\x80\xE4\xB8\xAD";
+    const int conts_len = sizeof(conts) - 1;
+    for (int max = 0; max <= conts_len; ++max) {
+        const int n = utf8_truncate(conts, conts_len, max);
+
+        if (n < 0 || n > max) {
+            printf("FAILED truncate test(leading continuation, max=%d, %d)\n",
+                   max, n);
+            return -1;
+        }
+    }
+    for (int n = 1; n <= 4; ++n) {
+        int ends[4];
+
+        utf8_split(conts, conts_len, n, ends);
+        for (int i = 0; i < n; ++i) {
+            if (ends[i] < (i ? ends[i-1] : 0) ||
+                    (i == n - 1 && ends[i] != conts_len)) {
+                printf("FAILED split test(leading continuation, n=%d, "
+                       "chunk %d, %d)\n", n, i, ends[i]);
+                return -1;
+            }
+        }
+    }
+
+    for (int n = 1; n <= 9; ++n) {
+        int ends[9];
+
+        utf8_split(buf, len, n, ends);
+        for (int i = 0; i < n; ++i) {
+            const int begin = i ? ends[i-1] : 0;
+
+            if (ends[i] < begin || ends[i] > len * (i + 1) / n ||
+                    ends[i] + 4 <= len * (i + 1) / n ||
+                    (ends[i] < len && (buf[ends[i]] & 0xC0) == 0x80) ||
+                    (i == n - 1 && ends[i] != len)) {
+                printf("FAILED split test(n=%d, chunk %d [%d, %d))\n",
+                       n, i, begin, ends[i]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Insert, remove and replace at every position, cutting chars */
+static int test_revalidate(void)
+{
+    static const unsigned int cps[] = { 0x41, 0x3B1, 0x4E2D, 0x1F600 };
+    static const char *edits[] = {
+        "", "a", "\xC2", "\x80", "\xBF\x80", "\xE4\xB8", "\xB8\xAD",
+        "\xE4\xB8\xAD", "\xF0\x9F\x98\x80", "\xED\xA0\x80",
+        "\xF4\x90\x80\x80", "\xC0\x80", "ab\xCE\xB1\xF0\x9F",
+    };
+    unsigned char doc[128], buf[128 + 8];
+    int len = 0;
+
+    for (int k = 0; len + 4 <= sizeof(doc); ++k)
+        len += encode_utf8(cps[k * 7 % 11 % 4], doc + len);
+
+    for (int start = 0; start <= len; ++start) {
+        for (int removed = 0; removed <= 4 && start + removed <= len;
+                ++removed) {
+            for (int e = 0; e < sizeof(edits)/sizeof(edits[0]); ++e) {
+                const int n = strlen(edits[e]);
+                const int buf_len = len - removed + n;
+
+                memcpy(buf, doc, start);
+                memcpy(buf + start, edits[e], n);
+                memcpy(buf + start + n, doc + start + removed,
+                       len - start - removed);
+
+                const int ret = utf8_revalidate(buf, buf_len, start,
+                                                start + n);
+                const int ref = ref_utf8(buf, buf_len);
+                if (ret != ref) {
+                    printf("FAILED revalidate test(%d:%d, start=%d, "
+                           "removed=%d, edit %d)\n",
+                           ret, ref, start, removed, e);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Feed buffer in chunks of every pattern, chars span chunks at all bytes */
+static int test_stream_buf(const void *f, const unsigned char *buf, int len)
+{
+    static const int chunks[][3] = {
+        { 1, 1, 1 }, { 2, 2, 2 }, { 3, 3, 3 }, { 5, 5, 5 }, { 1, 2, 3 },
+        { 63, 1, 2 }, { 64, 64, 64 }, { 65536, 65536, 65536 },
+    };
+    const int ref = ref_utf8(buf, len);
+
+    for (int k = 0; k < sizeof(chunks)/sizeof(chunks[0]); ++k) {
+        struct utf8_stream s;
+        long long ret;
+
+        utf8_stream_init(&s);
+        for (int i = 0, j = 0; i < len; ++j) {
+            int n = chunks[k][j % 3];
+
+            if (n > len - i)
+                n = len - i;
+            utf8_stream_update(&s, buf + i, n);
+            i += n;
+        }
+        ret = utf8_stream_finish(&s);
+
+        if (ret != ref) {
+            printf("FAILED stream test(%lld:%d, chunks %d, len=%d)\n",
+                   ret, ref, k, len);
+            if (len <= BOUNDARY_LEN)
+                print_test(buf, len);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Segments of every pattern, with empty ones, chars span segments */
+static int test_iov_buf(const void *f, const unsigned char *buf, int len)
+{
+    static const int segs[][3] = {
+        { 1, 1, 1 }, { 2, 0, 2 }, { 3, 3, 3 }, { 1, 0, 2 }, { 5, 1, 0 },
+        { 16, 1, 2 }, { 65536, 65536, 65536 },
+    };
+    const int ref = ref_utf8(buf, len);
+    struct iovec *iov = malloc((len * 2 + 1) * sizeof(struct iovec));
+    int ret = 0;
+
+    for (int k = 0; k < sizeof(segs)/sizeof(segs[0]) && ret == 0; ++k) {
+        int cnt = 0;
+
+        for (int i = 0, j = 0; i < len; ++j) {
+            int n = segs[k][j % 3];
+
+            if (n > len - i)
+                n = len - i;
+            iov[cnt].iov_base = (void *)(buf + i);
+            iov[cnt++].iov_len = n;
+            i += n;
+        }
+
+        const long long err = utf8_validate_iov(iov, cnt);
+        if (err != ref) {
+            printf("FAILED iov test(%lld:%d, segments %d, len=%d)\n",
+                   err, ref, k, len);
+            if (len <= BOUNDARY_LEN)
+                print_test(buf, len);
+            ret = -1;
+        }
+    }
+
+    free(iov);
+    return ret;
+}
+
+/*
+ * Ring buffer: whole buffer from several start positions, then by a
+ * producer writing chunks into a small ring, overwriting validated bytes
+ */
+static int test_ring_buf(const void *f, const unsigned char *buf, int len)
+{
+    static const int chunks[] = { 1, 50, 96, 3, 33, 2 };
+    const int ref = ref_utf8(buf, len);
+    unsigned char *ring = malloc(len + 97);
+    long long err;
+
+    for (int cap = len; cap <= len + 5; cap += 5) {
+        const int starts[] = { 0, 1, cap / 2, cap - 3, cap - 1 };
+
+        for (int k = 0; k < 5; ++k) {
+            const int start = starts[k];
+
+            if (start < 0 || start >= cap)
+                continue;
+            for (int i = 0; i < len; ++i)
+                ring[(start + i) % cap] = buf[i];
+            err = utf8_validate_ring(ring, cap, start, len);
+            if (err != ref) {
+                printf("FAILED ring test(%lld:%d, cap=%d, start=%d, "
+                       "len=%d)\n", err, ref, cap, start, len);
+                free(ring);
+                return -1;
+            }
+        }
+    }
+
+    struct utf8_ring r;
+    int head = 90;
+
+    utf8_ring_init(&r, head);
+    for (int i = 0, j = 0; i < len; ++j) {
+        int n = chunks[j % 6];
+
+        if (n > len - i)
+            n = len - i;
+        for (int k = 0; k < n; ++k, head = (head + 1) % 97)
+            ring[head] = buf[i++];
+        utf8_ring_update(&r, ring, 97, head);
+    }
+    err = utf8_ring_finish(&r);
+    free(ring);
+
+    if (err != ref) {
+        printf("FAILED ring update test(%lld:%d, len=%d)\n", err, ref, len);
+        if (len <= BOUNDARY_LEN)
+            print_test(buf, len);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int write_file(const char *path, const unsigned char *data, int len)
+{
+    FILE *fp = fopen(path, "wb");
+
+    if (fp == NULL || fwrite(data, 1, len, fp) != len || fclose(fp)) {
+        printf("FAILED write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+struct bulk_test {
+    char path[64];
+    long long expect, result;
+    int reported;
+};
+
+struct bulk_tests {
+    struct bulk_test *t;
+    int n, next;
+};
+
+static const char *bulk_test_next(void *arg)
+{
+    struct bulk_tests *bt = arg;
+
+    return bt->next < bt->n ? bt->t[bt->next++].path : NULL;
+}
+
+static void bulk_test_report(const char *path, long long err, void *arg)
+{
+    struct bulk_tests *bt = arg;
+
+    for (int i = 0; i < bt->n; ++i) {
+        if (strcmp(bt->t[i].path, path) == 0) {
+            bt->t[i].result = err;
+            ++bt->t[i].reported;
+        }
+    }
+}
+
+/* Write a char in two pieces to a FIFO, readers see a short read */
+static void *bulk_fifo_writer(void *arg)
+{
+    const char *path = arg;
+    sigset_t set;
+    int fd = -1;
+
+    /* EPIPE instead of SIGPIPE if the reader stops early */
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    /* Fails with ENXIO until the reader opens the FIFO */
+    for (int i = 0; fd < 0 && i < 1000; ++i) {
+        fd = open(path, O_WRONLY | O_NONBLOCK);
+        if (fd < 0)
+            usleep(1000);
+    }
+    if (fd >= 0) {
+        if (write(fd, "ab\xE4\xB8", 4) == 4) {
+            usleep(10000);
+            if (write(fd, "\xAD\n", 2) != 2)
+                printf("FAILED bulk test: reader closed FIFO early\n");
+        }
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/*
+ * Files in a temporary directory, errors around 64K read boundaries, chars
+ * spanning reads, empty, missing and unreadable files, and a FIFO returning
+ * short reads. Through io_uring and open/read/close.
+ */
+static int test_bulk(void)
+{
+    char dir[] = "/tmp/utf8-bulk-XXXXXX";
+    const int len = 200000;
+    const int offs[] = {
+        -1, 65535, 65536, 65537, 65534, 131071, 131072, len - 1,
+    };
+    const int nfiles = 3 * sizeof(offs)/sizeof(offs[0]) + 4;
+    struct bulk_test t[nfiles];
+    struct bulk_tests bt = { t, 0, 0 };
+    unsigned char *buf = malloc(len);
+    int n, ret = 0;
+
+    if (mkdtemp(dir) == NULL) {
+        printf("FAILED bulk test: mkdtemp\n");
+        free(buf);
+        return -1;
+    }
+
+    /* 3 bytes chars after 0~2 ascii, error at offs */
+    for (int pre = 0; pre < 3; ++pre) {
+        for (int k = 0; k < sizeof(offs)/sizeof(offs[0]); ++k) {
+            memset(buf, 'a', pre);
+            for (n = pre; n + 3 <= len; )
+                n += encode_utf8(0x4E2D, buf + n);
+            if (offs[k] >= 0)
+                buf[offs[k]] = offs[k] % 2 ? 0xC2 : 0x80;
+
+            struct bulk_test *p = &t[bt.n];
+            snprintf(p->path, sizeof(p->path), "%s/%d", dir, bt.n);
+            p->expect = ref_utf8(buf, n);
+            ++bt.n;
+
+            if (write_file(p->path, buf, n)) {
+                ret = -1;
+                goto out;
+            }
+        }
+    }
+
+    /* Empty file, missing file, directory */
+    snprintf(t[bt.n].path, sizeof(t[0].path), "%s/empty", dir);
+    t[bt.n++].expect = 0;
+    if (write_file(t[bt.n-1].path, buf, 0)) {
+        ret = -1;
+        goto out;
+    }
+    snprintf(t[bt.n].path, sizeof(t[0].path), "%s/missing", dir);
+    t[bt.n++].expect = -ENOENT;
+    snprintf(t[bt.n].path, sizeof(t[0].path), "%s", dir);
+    t[bt.n++].expect = -EISDIR;
+
+    /* Valid, a short read is not end of file */
+    const char *fifo = t[bt.n].path;
+    snprintf(t[bt.n].path, sizeof(t[0].path), "%s/fifo", dir);
+    t[bt.n++].expect = 0;
+    if (mkfifo(fifo, 0600)) {
+        printf("FAILED bulk test: mkfifo %s\n", fifo);
+        ret = -1;
+        goto out;
+    }
+
+    for (int flags = 0; flags <= BULK_SYNC && ret == 0; flags += BULK_SYNC) {
+        pthread_t writer;
+
+        for (int i = 0; i < bt.n; ++i)
+            t[i].reported = 0;
+        bt.next = 0;
+        if (pthread_create(&writer, NULL, bulk_fifo_writer, (void *)fifo)) {
+            printf("FAILED bulk test: pthread_create\n");
+            ret = -1;
+            break;
+        }
+        bulk_validate(bulk_test_next, bulk_test_report, &bt, flags);
+        pthread_join(writer, NULL);
+
+        for (int i = 0; i < bt.n; ++i) {
+            if (t[i].reported != 1 || t[i].result != t[i].expect) {
+                printf("FAILED bulk test(%s, %lld:%lld, reported %d, %s)\n",
+                       t[i].path, t[i].result, t[i].expect, t[i].reported,
+                       flags & BULK_SYNC ? "sync" : "io_uring");
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+out:
+    for (int i = 0; i < bt.n; ++i)
+        unlink(t[i].path);
+    rmdir(dir);
+    free(buf);
+    return ret;
+}
+
+struct scan_test {
+    pthread_mutex_t lock;
+    const char *paths[2];
+    long long errs[2], lines[2], columns[2];
+    int reported[2], others;
+};
+
+static void scan_test_report(const char *path, long long err, long long line,
+                             long long column, void *arg)
+{
+    struct scan_test *st = arg;
+    int i;
+
+    pthread_mutex_lock(&st->lock);
+    for (i = 0; i < 2 && strcmp(st->paths[i], path) != 0; ++i)
+        ;
+    if (i < 2 && err == st->errs[i] && line == st->lines[i] &&
+            column == st->columns[i])
+        ++st->reported[i];
+    else
+        ++st->others;
+    pthread_mutex_unlock(&st->lock);
+}
+
+/*
+ * Tree of nested and sibling directories with a symbolic link, invalid
+ * files mapped and streamed (mmap_max 1000), by 1 and 4 workers. Reported
+ * line and column must match ref error index.
+ */
+static int test_scan(void)
+{
+    char dir[] = "/tmp/utf8-scan-XXXXXX";
+    char path[3][64], sub[64];
+    const int len = 300000;
+    unsigned char *buf = malloc(len);
+    struct scan_test st;
+    int n, ret = 0;
+
+    if (mkdtemp(dir) == NULL) {
+        printf("FAILED scan test: mkdtemp\n");
+        free(buf);
+        return -1;
+    }
+
+    /*
+     * Big file with error after first streaming buffers, its line spans a
+     * streaming buffer end which splits a char
+     */
+    for (n = 0; n + 4 <= len; ) {
+        n += encode_utf8(0x4E2D, buf + n);
+        if (n < 250000 && n % 301 < 3)
+            buf[n++] = '\n';
+    }
+    buf[270001] = 0xFF;
+    snprintf(sub, sizeof(sub), "%s/d1", dir);
+    mkdir(sub, 0755);
+    snprintf(sub, sizeof(sub), "%s/d1/d2", dir);
+    mkdir(sub, 0755);
+    snprintf(path[0], sizeof(path[0]), "%s/d1/d2/big", dir);
+    snprintf(path[1], sizeof(path[1]), "%s/d1/small", dir);
+    snprintf(path[2], sizeof(path[2]), "%s/d1/small.link", dir);
+    ret |= write_file(path[0], buf, n);
+    ret |= write_file(path[1],
+            (const unsigned char *)"ab\n\xCE\xBC\xE4\xB8\xAD\n\n  \xC0\x80",
+            15);
+    if (symlink("small", path[2]))
+        ret = -1;
+    snprintf(sub, sizeof(sub), "%s/empty", dir);
+    ret |= write_file(sub, buf, 0);
+    memset(buf, 'a', 5000);
+    for (int i = 0; i < 20 && ret == 0; ++i) {
+        snprintf(sub, sizeof(sub), "%s/s%d", dir, i);
+        mkdir(sub, 0755);
+        for (int j = 0; j < 5 && ret == 0; ++j) {
+            snprintf(sub, sizeof(sub), "%s/s%d/%d", dir, i, j);
+            ret = write_file(sub, buf, 1000 * (i % 5) + j);
+        }
+    }
+
+    pthread_mutex_init(&st.lock, NULL);
+    for (int i = 0; i < 2; ++i) {
+        FILE *fp = fopen(path[i], "rb");
+
+        n = fread(buf, 1, len, fp);
+        fclose(fp);
+        st.paths[i] = path[i];
+        st.errs[i] = ref_utf8(buf, n);
+        st.lines[i] = st.columns[i] = 1;
+        for (int k = 0; k < st.errs[i] - 1; ++k) {
+            if (buf[k] == '\n') {
+                ++st.lines[i];
+                st.columns[i] = 1;
+            } else if ((buf[k] & 0xC0) != 0x80) {
+                ++st.columns[i];
+            }
+        }
+    }
+    for (int k = 0; k < 4 && ret == 0; ++k) {
+        const struct scan_opts opts = {
+            .threads = k % 2 ? 4 : 1,
+            .mmap_max = k / 2 ? 1000 : 0,
+        };
+        struct scan_stats stats;
+
+        memset(st.reported, 0, sizeof(st.reported));
+        st.others = 0;
+        ret = scan_tree(dir, &opts, scan_test_report, &st, &stats);
+        if (ret || stats.files != 103 || stats.dirs != 23 ||
+                stats.invalid != 2 || stats.failed != 0)
+            ret = -1;
+
+        /* One file as root */
+        if (ret == 0)
+            ret = scan_tree(path[1], &opts, scan_test_report, &st, &stats);
+        if (ret || stats.files != 1 || st.reported[0] != 1 ||
+                st.reported[1] != 2 || st.others)
+            ret = -1;
+
+        if (ret)
+            printf("FAILED scan test(threads %d, mmap_max %lld, "
+                   "reported %d %d, others %d)\n", opts.threads,
+                   opts.mmap_max, st.reported[0], st.reported[1], st.others);
+    }
+    pthread_mutex_destroy(&st.lock);
+
+    for (int i = 0; i < 20; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            snprintf(sub, sizeof(sub), "%s/s%d/%d", dir, i, j);
+            unlink(sub);
+        }
+        snprintf(sub, sizeof(sub), "%s/s%d", dir, i);
+        rmdir(sub);
+    }
+    for (int i = 0; i < 3; ++i)
+        unlink(path[i]);
+    snprintf(sub, sizeof(sub), "%s/empty", dir);
+    unlink(sub);
+    snprintf(sub, sizeof(sub), "%s/d1/d2", dir);
+    rmdir(sub);
+    snprintf(sub, sizeof(sub), "%s/d1", dir);
+    rmdir(sub);
+    rmdir(dir);
+    free(buf);
+    return ret;
+}
+
+struct pipe_io {
+    int fd;
+    unsigned char *buf;
+    int len;
+};
+
+/* Feed input pipe in odd sized writes */
+static void *pipe_writer(void *arg)
+{
+    struct pipe_io *io = arg;
+
+    for (int i = 0, n; i < io->len; i += n) {
+        n = io->len - i < 7777 ? io->len - i : 7777;
+        n = write(io->fd, io->buf + i, n);
+        if (n <= 0)
+            break;
+    }
+    close(io->fd);
+    return NULL;
+}
+
+static void *pipe_reader(void *arg)
+{
+    struct pipe_io *io = arg;
+    int n;
+
+    while ((n = read(io->fd, io->buf + io->len, 65536)) > 0)
+        io->len += n;
+    return NULL;
+}
+
+/* Input and output from and to pipe or regular file */
+static int test_filter_io(const unsigned char *data, int len, int in_pipe,
+                          int out_pipe)
+{
+    const int ref = ref_utf8(data, len);
+    const int ref_len = ref ? ref - 1 : len;
+    struct pipe_io in = { -1, (unsigned char *)data, len };
+    struct pipe_io out = { -1, malloc(len + 65536), 0 };
+    pthread_t writer, reader;
+    int in_fds[2], out_fds[2];
+    FILE *in_file = NULL, *out_file = NULL;
+    long long ret;
+
+    if (in_pipe) {
+        if (pipe(in_fds))
+            return -1;
+        in.fd = in_fds[1];
+        pthread_create(&writer, NULL, pipe_writer, &in);
+    } else {
+        in_file = tmpfile();
+        fwrite(data, 1, len, in_file);
+        fflush(in_file);
+        in_fds[0] = fileno(in_file);
+        lseek(in_fds[0], 0, SEEK_SET);
+    }
+    if (out_pipe) {
+        if (pipe(out_fds))
+            return -1;
+        out.fd = out_fds[0];
+        pthread_create(&reader, NULL, pipe_reader, &out);
+    } else {
+        out_file = tmpfile();
+        out_fds[1] = fileno(out_file);
+    }
+
+    ret = filter_fd(in_fds[0], out_fds[1]);
+
+    if (in_pipe) {
+        close(in_fds[0]);
+        pthread_join(writer, NULL);
+    } else {
+        fclose(in_file);
+    }
+    if (out_pipe) {
+        close(out_fds[1]);
+        pthread_join(reader, NULL);
+        close(out_fds[0]);
+    } else {
+        lseek(out_fds[1], 0, SEEK_SET);
+        out.len = read(out_fds[1], out.buf, len + 1);
+        fclose(out_file);
+    }
+
+    const int bad = ret != ref || out.len != ref_len ||
+                    memcmp(out.buf, data, ref_len);
+    if (bad)
+        printf("FAILED filter test(%lld:%d, %d:%d bytes, %s to %s)\n",
+               ret, ref, out.len, ref_len, in_pipe ? "pipe" : "file",
+               out_pipe ? "pipe" : "file");
+    free(out.buf);
+    return bad ? -1 : 0;
+}
+
+/* Errors around block seams and truncated char at end, chars span seams */
+static int test_filter(void)
+{
+    const int len = 3 * FILTER_BUF + 1000;
+    const int offs[] = {
+        -1, 0, FILTER_BUF - 1, FILTER_BUF, FILTER_BUF + 1,
+        2 * FILTER_BUF + 2, len - 1,
+    };
+    unsigned char *buf = malloc(len);
+    void (*sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+    int ret = 0;
+
+    for (int k = 0; k < sizeof(offs)/sizeof(offs[0]) && ret == 0; ++k) {
+        int n = 1;
+
+        buf[0] = 'a';
+        while (n + 3 <= len)
+            n += encode_utf8(0x4E2D, buf + n);
+        if (offs[k] >= 0)
+            buf[offs[k]] = offs[k] == len - 1 ? 0xE4 : 0x80;
+        if (offs[k] == len - 1)
+            n = len;
+
+        for (int io = 0; io < 4 && ret == 0; ++io)
+            ret = test_filter_io(buf, n, io & 1, io >> 1);
+    }
+
+    signal(SIGPIPE, sigpipe);
+    free(buf);
+    return ret;
+}
+
+/* Surrogate pairs, C0 80 and sequences legal only in UTF-8 */
+static const char *cesu8_seqs[] = {
+    "\xED\xA0\x80\xED\xB0\x80", "\xED\xAF\xBF\xED\xBF\xBF",
+    "\xED\xA0\x80\xED\xB0\x80\xED\xB0\x80", "\xED\xA0\x80\xED\xA0\x80",
+    "\xED\xB0\x80\xED\xA0\x80", "\xED\xA0\x80\xED\xB0",
+    "\xED\xA0\x80\xED", "\xED\xA0\x80\xED\x9F\xBF", "\xED\xA0\x80\xC2\x80",
+    "\xED\xA0\x80\xED\xB0\xC0", "\xED\x9F\xBF\xED\xB0\x80",
+    "\xC0\x80", "\xC0\x80\xC0\x80", "\xC0\x81", "\xC0\xBF", "\xC0\xC0\x80",
+    "\xC1\x80", "\xC0", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF",
+};
+
+/* All sequences of test_boundary(), plus CESU-8 specific ones */
+static int test_cesu8(const struct ftab *ftab,
+                      int (*ref_func)(const unsigned char *, int))
+{
+    const struct validate_arg arg = { ftab, ref_func };
+
+    for (int i = 0; i < sizeof(cesu8_seqs)/sizeof(cesu8_seqs[0]); ++i) {
+        if (test_boundary_seq(test_validate_buf, &arg,
+                              (const unsigned char *)cesu8_seqs[i],
+                              strlen(cesu8_seqs[i])))
+            return -1;
+    }
+
+    return test_boundary(ftab, ref_func);
+}
+
+/* Encode code point in MUTF-8, return bytes */
+static int encode_mutf8(unsigned int u, unsigned char *p)
+{
+    if (u == 0) {
+        p[0] = 0xC0;
+        p[1] = 0x80;
+        return 2;
+    } else if (u >= 0x10000) {
+        u -= 0x10000;
+        encode_utf8(0xD800 + (u >> 10), p);
+        encode_utf8(0xDC00 + (u & 0x3FF), p + 3);
+        return 6;
+    }
+    return encode_utf8(u, p);
+}
+
+struct conv_arg {
+    const struct ftab_conv *ftab;
+    const unsigned char *seq, *seq8;    /* No output check if seq is NULL */
+    int seq_len, seq8_len;
+};
+
+/*
+ * Ill-formed input must report error as ref_mutf8(). Sequence in well-formed
+ * input must be converted to seq8, and output one byte short must fail.
+ */
+static int test_conv_buf(const void *arg, const unsigned char *buf, int len)
+{
+    const struct conv_arg *a = arg;
+    unsigned char expected[BOUNDARY_LEN], out[BOUNDARY_LEN + 1];
+    const int ref = ref_mutf8(buf, len);
+    size_t out_len = len;
+    int ret = a->ftab->func(buf, len, out, &out_len);
+
+    if (ref || a->seq == NULL) {
+        if ((ret == 0) != (ref == 0) || (ret > 0 && ret != ref)) {
+            printf("FAILED conversion test(%d:%d, len=%d): ", ret, ref, len);
+            print_test(buf, len);
+            return -1;
+        }
+        return 0;
+    }
+
+    size_t len8 = len;
+    memcpy(expected, buf, len);
+    for (int off = 0; off + a->seq_len <= len; ++off) {
+        if (memcmp(buf+off, a->seq, a->seq_len) == 0) {
+            memcpy(expected+off, a->seq8, a->seq8_len);
+            memcpy(expected+off+a->seq8_len, buf+off+a->seq_len,
+                   len - off - a->seq_len);
+            len8 = len - a->seq_len + a->seq8_len;
+            break;
+        }
+    }
+
+    if (ret || out_len != len8 || memcmp(out, expected, len8)) {
+        printf("FAILED conversion test(%d, len=%d): ", ret, len);
+        print_test(buf, len);
+        return -1;
+    }
+
+    /* One byte short of output buffer */
+    out_len = len8 - 1;
+    ret = a->ftab->func(buf, len, out, &out_len);
+    if (ret == 0) {
+        printf("FAILED overflow test(len=%d): ", len);
+        print_test(buf, len);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Convert MUTF-8 encoded code point at block seams, output must be same as
+ * encode_utf8(). Ill-formed input must report error as ref_mutf8().
+ */
+static int test_mutf8_conv(const struct ftab_conv *ftab)
+{
+    static const unsigned int cps[] = {
+        0x00, 0x01, 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF,
+        0x10000, 0x103FF, 0x10400, 0x1F600, 0xFFFFF, 0x10FFFF,
+    };
+
+    unsigned char seq[6], seq8[4];
+    struct conv_arg arg = { ftab, seq, seq8 };
+
+    for (int k = 0; k < sizeof(cps)/sizeof(cps[0]); ++k) {
+        arg.seq_len = encode_mutf8(cps[k], seq);
+        arg.seq8_len = encode_utf8(cps[k], seq8);
+
+        if (test_boundary_seq(test_conv_buf, &arg, seq, arg.seq_len))
+            return -1;
+    }
+
+    /* Ill-formed input */
+    arg.seq = NULL;
+    for (int k = 0; k < sizeof(cesu8_seqs)/sizeof(cesu8_seqs[0]); ++k) {
+        if (test_boundary_seq(test_conv_buf, &arg,
+                              (const unsigned char *)cesu8_seqs[k],
+                              strlen(cesu8_seqs[k])))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Surrogates around pairs, all sequences of test_boundary() */
+static int test_wtf8_boundary(const struct ftab *ftab)
+{
+    static const char *seqs[] = {
+        "\xED\xA0\x80", "\xED\xBF\xBF", "\xED\xA0\x80\xED\xB0\x80",
+        "\xED\xAF\xBF\xED\xBF\xBF", "\xED\xB0\x80\xED\xA0\x80",
+        "\xED\xA0\x80\xED\xA0\x80\xED\xB0\x80", "\xED\xA0\x80\xED",
+        "\xED\xA0\x80\xED\xB0", "\xED\xA0\x80\xED\x9F\xBF",
+        "\xED\xA0\x80\xF0\x90\x80\x80", "\xF0\x90\x80\x80\xED\xB0\x80",
+    };
+    const struct validate_arg arg = { ftab, ref_wtf8 };
+
+    for (int i = 0; i < sizeof(seqs)/sizeof(seqs[0]); ++i) {
+        if (test_boundary_seq(test_validate_buf, &arg,
+                              (const unsigned char *)seqs[i], strlen(seqs[i])))
+            return -1;
+    }
+
+    return test_boundary(ftab, ref_wtf8);
+}
+
+static int test(const unsigned char *data, int len, const struct ftab *ftab)
+{
+    int ret_standard = ftab->func(data, len);
+    int ret_manual = test_manual(ftab);
+    int ret_boundary = test_boundary(ftab, ref_utf8);
+    printf("%s\n", ftab->name);
+    printf("standard test: %s\n", ret_standard ? "FAIL" : "pass");
+    printf("manual test: %s\n", ret_manual ? "FAIL" : "pass");
+    printf("boundary test: %s\n", ret_boundary ? "FAIL" : "pass");
+
+    return ret_standard | ret_manual | ret_boundary;
+}
+
+typedef int (*bench_func)(void *arg, const unsigned char *data, int len);
+
+/*
+ * Call func over 1GB of data and print bandwidth. Func returns non-zero on
+ * failure. Done, if given, checks results after timing, returns non-zero on
+ * failure and may leave details in note, printed after status.
+ */
+static int bench_run(const char *name, bench_func func, void *arg,
+                     const unsigned char *data, int len,
+                     int (*done)(void *arg, char *note, int size))
+{
+    const int loops = 1024*1024*1024/len;
+    int ret = 0;
+    char note[64] = "";
+    double time, size;
+    struct timeval tv1, tv2;
+
+    fprintf(stderr, "bench %s... ", name);
+    gettimeofday(&tv1, 0);
+    for (int i = 0; i < loops; ++i)
+        ret |= func(arg, data, len);
+    gettimeofday(&tv2, 0);
+    if (done)
+        ret |= done(arg, note, sizeof(note));
+    printf("%s%s\n", ret?"FAIL":"pass", note);
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    size = ((double)len * loops) / (1024*1024);
+    printf("time: %.4f s\n", time);
+    printf("data: %.0f MB\n", size);
+    printf("BW: %.2f MB/s\n", size / time);
+
+    return ret;
+}
+
+static int bench_validate(void *arg, const unsigned char *data, int len)
+{
+    const struct ftab *ftab = arg;
+
+    return ftab->func(data, len);
+}
+
+static int bench(const unsigned char *data, int len, const struct ftab *ftab)
+{
+    bench_run(ftab->name, bench_validate, (void *)ftab, data, len, NULL);
+
+    return 0;
+}
+
+struct bench_cstr_arg {
+    const struct ftab_cstr *ftab;
+    size_t len, expected;
+};
+
+static int bench_cstr_func(void *arg, const unsigned char *data, int len)
+{
+    struct bench_cstr_arg *a = arg;
+
+    return a->ftab->func((const char *)data, &a->len);
+}
+
+static int bench_cstr_done(void *arg, char *note, int size)
+{
+    const struct bench_cstr_arg *a = arg;
+
+    return a->len != a->expected;
+}
+
+static int bench_cstr(const char *str, int len, const struct ftab_cstr *ftab)
+{
+    struct bench_cstr_arg arg = { ftab, 0, len };
+
+    bench_run(ftab->name, bench_cstr_func, &arg, (const unsigned char *)str,
+              len, bench_cstr_done);
+
+    return 0;
+}
+
+struct bench_policy_arg {
+    const struct ftab_policy *ftab;
+    unsigned int policy;
+};
+
+static int bench_policy_func(void *arg, const unsigned char *data, int len)
+{
+    const struct bench_policy_arg *a = arg;
+
+    return a->ftab->func(data, len, a->policy);
+}
+
+static int bench_policy(const unsigned char *data, int len,
+                        const struct ftab_policy *ftab, unsigned int policy)
+{
+    struct bench_policy_arg arg = { ftab, policy };
+
+    bench_run(ftab->name, bench_policy_func, &arg, data, len, NULL);
+
+    return 0;
+}
+
+struct bench_count_arg {
+    const struct ftab_count *ftab;
+    size_t count;
+};
+
+static int bench_count_func(void *arg, const unsigned char *data, int len)
+{
+    struct bench_count_arg *a = arg;
+
+    return a->ftab->func(data, len, &a->count);
+}
+
+static int bench_count_done(void *arg, char *note, int size)
+{
+    const struct bench_count_arg *a = arg;
+
+    snprintf(note, size, " (%zu chars)", a->count);
+    return 0;
+}
+
+static int bench_count(const unsigned char *data, int len,
+                       const struct ftab_count *ftab)
+{
+    struct bench_count_arg arg = { ftab, 0 };
+
+    bench_run(ftab->name, bench_count_func, &arg, data, len,
+              bench_count_done);
+
+    return 0;
+}
+
+struct bench_index_arg {
+    const struct ftab_index *ftab;
+    int *index;
+    size_t count;
+};
+
+static int bench_index_func(void *arg, const unsigned char *data, int len)
+{
+    struct bench_index_arg *a = arg;
+
+    return a->ftab->build(data, len, a->index, &a->count);
+}
+
+/* Build index, then look up offsets of pseudo random chars */
+static int bench_index(const unsigned char *data, int len,
+                       const struct ftab_index *ftab)
+{
+    const int lookups = 1024*1024;
+    struct bench_index_arg arg = {
+        ftab, malloc(UTF8_INDEX_SIZE(len) * sizeof(int)), 0,
+    };
+    size_t sum = 0;
+    double time;
+    struct timeval tv1, tv2;
+
+    bench_run(ftab->name, bench_index_func, &arg, data, len, NULL);
+
+    gettimeofday(&tv1, 0);
+    for (unsigned int i = 0, k = 1; i < lookups; ++i) {
+        k = k * 1103515245 + 12345;
+        sum += ftab->offset(data, len, arg.index, arg.count,
+                            k % (arg.count + 1));
+    }
+    gettimeofday(&tv2, 0);
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    printf("lookup: %.1f ns (%zu)\n", time * 1e9 / lookups, sum);
+
+    free(arg.index);
+    return 0;
+}
+
+struct bench_json_arg {
+    const struct ftab_json *ftab;
+    uint64_t *mask;
+    size_t escapes;
+};
+
+static int bench_json_func(void *arg, const unsigned char *data, int len)
+{
+    struct bench_json_arg *a = arg;
+
+    return a->ftab->func(data, len, a->mask, &a->escapes);
+}
+
+static int bench_json_done(void *arg, char *note, int size)
+{
+    const struct bench_json_arg *a = arg;
+
+    snprintf(note, size, " (%zu escapes)", a->escapes);
+    return 0;
+}
+
+static int bench_json(const unsigned char *data, int len,
+                      const struct ftab_json *ftab)
+{
+    struct bench_json_arg arg = {
+        ftab, malloc(UTF8_JSON_MASK_SIZE(len) * sizeof(uint64_t)), 0,
+    };
+
+    bench_run(ftab->name, bench_json_func, &arg, data, len, bench_json_done);
+
+    free(arg.mask);
+    return 0;
+}
+
+/* Two passes baseline: validate, then scan for escapes */
+static int utf8_validate_then_json(const unsigned char *data, int len,
+                                   uint64_t *mask, size_t *escapes)
+{
+    const int ret = utf8_validate(data, len);
+    size_t n = 0;
+
+    if (ret)
+        return ret;
+    memset(mask, 0, UTF8_JSON_MASK_SIZE(len) * sizeof(uint64_t));
+    for (int i = 0; i < len; ++i) {
+        if (data[i] < 0x20 || data[i] == '"' || data[i] == '\\') {
+            mask[i / 64] |= 1ULL << (i % 64);
+            ++n;
+        }
+    }
+    *escapes = n;
+
+    return 0;
+}
+
+struct bench_lines_arg {
+    const struct ftab_lines *ftab;
+    int *ends, *errors;
+    int n, max_lines;
+};
+
+static int bench_lines_func(void *arg, const unsigned char *data, int len)
+{
+    struct bench_lines_arg *a = arg;
+
+    a->n = a->ftab->func(data, len, "\n", a->ends, a->errors, a->max_lines);
+    return 0;
+}
+
+/* Errors are per line, checked once after timing */
+static int bench_lines_done(void *arg, char *note, int size)
+{
+    const struct bench_lines_arg *a = arg;
+    int ret = 0;
+
+    for (int i = 0; i < a->n; ++i)
+        ret |= a->errors[i];
+    snprintf(note, size, " (%d lines)", a->n);
+    return ret;
+}
+
+static int bench_lines(const unsigned char *data, int len,
+                       const struct ftab_lines *ftab)
+{
+    struct bench_lines_arg arg = {
+        ftab, malloc((len + 1) * sizeof(int)), malloc((len + 1) * sizeof(int)),
+        0, len + 1,
+    };
+
+    bench_run(ftab->name, bench_lines_func, &arg, data, len,
+              bench_lines_done);
+
+    free(arg.ends);
+    free(arg.errors);
+    return 0;
+}
+
+/* Two passes baseline: validate whole string, then memchr() lines */
+static int utf8_validate_then_memchr(const unsigned char *data, int len,
+                                     const char *delims, int *ends,
+                                     int *errors, int max_lines)
+{
+    const int err = utf8_validate(data, len);
+    const unsigned char *p = data, *end = data + len;
+    int n = 0;
+
+    while (p < end && n < max_lines) {
+        const unsigned char *q = memchr(p, delims[0], end - p);
+
+        ends[n] = q ? q - data : len;
+        errors[n++] = err;
+        p = (q ? q : end) + 1;
+    }
+
+    return n;
+}
+
+struct bench_iov_arg {
+    struct iovec *iov;
+    int cnt;
+    unsigned char *buf;
+};
+
+static int bench_iov_func(void *arg, const unsigned char *data, int len)
+{
+    const struct bench_iov_arg *a = arg;
+
+    return utf8_validate_iov(a->iov, a->cnt) != 0;
+}
+
+static int bench_coalesce_func(void *arg, const unsigned char *data, int len)
+{
+    const struct bench_iov_arg *a = arg;
+    unsigned char *p = a->buf;
+
+    for (int k = 0; k < a->cnt; ++k) {
+        memcpy(p, a->iov[k].iov_base, a->iov[k].iov_len);
+        p += a->iov[k].iov_len;
+    }
+    return utf8_validate(a->buf, len);
+}
+
+/* Data as 1460 bytes segments (TCP payload), validated in place or copied */
+static int bench_iov(const unsigned char *data, int len, int coalesce)
+{
+    const int seg = 1460, cnt = (len + seg - 1) / seg;
+    struct bench_iov_arg arg = {
+        malloc(cnt * sizeof(struct iovec)), cnt, malloc(len),
+    };
+
+    for (int i = 0; i < cnt; ++i) {
+        arg.iov[i].iov_base = (void *)(data + i * seg);
+        arg.iov[i].iov_len = i == cnt - 1 ? len - i * seg : seg;
+    }
+
+    if (coalesce)
+        bench_run("copy+utf8range", bench_coalesce_func, &arg, data, len,
+                  NULL);
+    else
+        bench_run("utf8_validate_iov", bench_iov_func, &arg, data, len, NULL);
+
+    free(arg.buf);
+    free(arg.iov);
+    return 0;
+}
+
+/* 16 bytes edit at random positions, whole buffer validation as baseline */
+static int bench_revalidate(const unsigned char *data, int len)
+{
+    const int loops = 1024*1024;
+    int ret = 0;
+    double time;
+    struct timeval tv1, tv2;
+
+    fprintf(stderr, "bench revalidate... ");
+    gettimeofday(&tv1, 0);
+    for (unsigned int i = 0, k = 1; i < loops; ++i) {
+        k = k * 1103515245 + 12345;
+        const int start = utf8_truncate(data, len, k % len);
+        const int end = utf8_truncate(data, len, start + 16);
+        ret |= utf8_revalidate(data, len, start, end);
+    }
+    gettimeofday(&tv2, 0);
+    printf("%s\n", ret?"FAIL":"pass");
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    printf("revalidate: %.1f ns\n", time * 1e9 / loops);
+
+    gettimeofday(&tv1, 0);
+    for (int i = 0; i < loops / 64; ++i)
+        ret |= utf8_validate(data, len);
+    gettimeofday(&tv2, 0);
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    printf("utf8_validate: %.1f ns\n", time * 1e9 / (loops / 64));
+
+    return 0;
+}
+
+#define CACHE_BIG       (256*1024*1024)     /* Out of cache buffer */
+#define CACHE_CHUNK     (4*1024*1024)       /* Validated between chases */
+#define CACHE_PASSES    4
+
+struct cache_bench {
+    const unsigned char *big;
+    int big_len;
+    const size_t *ring;         /* Hot set, each line points to next one */
+    size_t lines;
+};
+
+static volatile size_t chase_sink;
+
+/* Workload: chase pointers once around the ring, return seconds */
+static double chase(const struct cache_bench *cb)
+{
+    struct timeval tv1, tv2;
+    size_t k = 0;
+    double time;
+
+    gettimeofday(&tv1, 0);
+    for (size_t i = 0; i < cb->lines; ++i)
+        k = cb->ring[k];
+    gettimeofday(&tv2, 0);
+    chase_sink = k;
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    return time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+}
+
+/* Validate in chunks, each followed by a round of the workload */
+static int bench_cache_one(const struct cache_bench *cb,
+                           const struct ftab *ftab)
+{
+    double time = 0, chase_time = 0;
+    int chunks = 0, ret = 0;
+    struct timeval tv1, tv2;
+
+    fprintf(stderr, "bench %s... ", ftab->name);
+    for (int pass = 0; pass < CACHE_PASSES; ++pass) {
+        for (int pos = 0; pos < cb->big_len; ++chunks) {
+            const int len = utf8_truncate(cb->big + pos, cb->big_len - pos,
+                                          CACHE_CHUNK);
+
+            gettimeofday(&tv1, 0);
+            ret |= ftab->func(cb->big + pos, len);
+            gettimeofday(&tv2, 0);
+            time += tv2.tv_usec - tv1.tv_usec;
+            time += (tv2.tv_sec - tv1.tv_sec) * 1000000.0;
+            pos += len;
+
+            chase_time += chase(cb);
+        }
+    }
+    printf("%s\n", ret?"FAIL":"pass");
+
+    printf("BW: %.2f MB/s\n",
+           (double)cb->big_len * CACHE_PASSES / (1024*1024) / (time / 1e6));
+    printf("workload: %.1f ns\n", chase_time * 1e9 / (chunks * cb->lines));
+
+    return ret;
+}
+
+/*
+ * Validation of a buffer much bigger than cache, and the cache pollution
+ * it causes to a co-running workload with a hot set of given bytes, seen
+ * as the workload latency. Large buffer mode kernels ("_nt") are compared
+ * with their defaults.
+ */
+static int bench_cache(const unsigned char *data, int len, size_t hot)
+{
+    const int big_len = CACHE_BIG / len * len;
+    const size_t stride = 64 / sizeof(size_t), lines = hot / 64;
+    unsigned char *big = malloc(big_len);
+    size_t *ring = malloc(lines * 64), *perm = malloc(lines * sizeof(size_t));
+    double chase_time = 0;
+    int ret = 0;
+
+    if (big == NULL || ring == NULL || perm == NULL || lines < 2) {
+        printf("FAIL\n");
+        free(big);
+        free(ring);
+        free(perm);
+        return 1;
+    }
+
+    for (int i = 0; i < big_len; i += len)
+        memcpy(big + i, data, len);
+
+    /* Lines in random order, hardware prefetcher cannot follow */
+    for (size_t i = 0; i < lines; ++i)
+        perm[i] = i;
+    for (size_t i = lines - 1, k = 1; i > 0; --i) {
+        k = k * 6364136223846793005ULL + 1442695040888963407ULL;
+        const size_t j = (k >> 33) % (i + 1), t = perm[i];
+
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+    for (size_t i = 0; i < lines; ++i)
+        ring[perm[i] * stride] = perm[(i + 1) % lines] * stride;
+    free(perm);
+
+    const struct cache_bench cb = { big, big_len, ring, lines };
+
+    printf("=============== Bench cache pollution ===============\n");
+    printf("buffer: %d MB, chunk: %d KB, hot set: %zu KB\n",
+           big_len >> 20, CACHE_CHUNK >> 10, hot >> 10);
+    chase(&cb);
+    for (int i = 0; i < 16; ++i)
+        chase_time += chase(&cb);
+    printf("workload alone: %.1f ns\n\n", chase_time * 1e9 / (16 * lines));
+
+    for (int i = 0; i < ftab_size; ++i) {
+        const char *name = ftab[i].name;
+        const size_t n = strlen(name);
+
+        if (n <= 3 || strcmp(name + n - 3, "_nt"))
+            continue;
+        for (int k = 0; k < ftab_size; ++k) {
+            if (strlen(ftab[k].name) == n - 3 &&
+                strncmp(ftab[k].name, name, n - 3) == 0) {
+                ret |= bench_cache_one(&cb, &ftab[k]);
+                printf("\n");
+            }
+        }
+        ret |= bench_cache_one(&cb, &ftab[i]);
+        printf("\n");
+    }
+
+    free(big);
+    free(ring);
+    return ret;
+}
+
+struct bench_skip_arg {
+    const struct ftab_skip *ftab;
+    size_t count;
+};
+
+static int bench_skip_func(void *arg, const unsigned char *data, int len)
+{
+    const struct bench_skip_arg *a = arg;
+
+    return a->ftab->func(data, len, a->count - 1) != len - 1;
+}
+
+/* Skip to last char, scan whole buffer */
+static int bench_skip(const unsigned char *data, int len,
+                      const struct ftab_skip *ftab)
+{
+    struct bench_skip_arg arg = { ftab, 0 };
+
+    utf8_validate_count(data, len, &arg.count);
+    bench_run(ftab->name, bench_skip_func, &arg, data, len, NULL);
+
+    return 0;
+}
+
+/* Two passes baseline: validate, then count non continuation bytes */
+static int utf8_validate_then_count(const unsigned char *data, int len,
+                                    size_t *count)
+{
+    const int ret = utf8_validate(data, len);
+    size_t n = 0;
+
+    if (ret)
+        return ret;
+    for (int i = 0; i < len; ++i)
+        n += (signed char)data[i] > (signed char)0xBF;
+    *count = n;
+
+    return 0;
+}
+
+struct bench_conv_arg {
+    const struct ftab_conv *ftab;
+    unsigned char *out;
+};
+
+static int bench_conv_func(void *arg, const unsigned char *data, int len)
+{
+    const struct bench_conv_arg *a = arg;
+    size_t out_len = len;
+
+    return a->ftab->func(data, len, a->out, &out_len);
+}
+
+static int bench_conv(const unsigned char *data, int len,
+                      const struct ftab_conv *ftab)
+{
+    struct bench_conv_arg arg = { ftab, malloc(len) };
+
+    bench_run(ftab->name, bench_conv_func, &arg, data, len, NULL);
+
+    free(arg.out);
+    return 0;
+}
+
+/* Re-encode valid UTF-8 as MUTF-8, buffer grows at most 50% */
+static unsigned char *to_mutf8(const unsigned char *data, int len, int *len2)
+{
+    unsigned char *mutf8 = malloc(len / 2 * 3 + 2);
+    unsigned char *p = mutf8;
+
+    for (int i = 0; i < len; ) {
+        const unsigned char byte1 = data[i];
+        const int bytes = byte1 < 0xC0 ? 1 : byte1 < 0xE0 ? 2 :
+                          byte1 < 0xF0 ? 3 : 4;
+
+        if (bytes == 4) {
+            const unsigned int u = ((byte1 & 0x07) << 18) |
+                ((data[i+1] & 0x3F) << 12) | ((data[i+2] & 0x3F) << 6) |
+                (data[i+3] & 0x3F);
+            p += encode_mutf8(u, p);
+        } else if (byte1 == 0) {
+            p += encode_mutf8(0, p);
+        } else {
+            memcpy(p, data + i, bytes);
+            p += bytes;
+        }
+        i += bytes;
+    }
+
+    *len2 = p - mutf8;
+    return mutf8;
+}
+
+/* Baseline of C string validation: strlen() then validate */
+static int utf8_strlen_validate(const char *str, size_t *len)
+{
+    *len = strlen(str);
+    return utf8_validate((const unsigned char *)str, *len);
+}
+
+/* Paths from command line, or one per line from stdin */
+struct files_arg {
+    char **paths;
+    int npaths, next;
+    char *line;
+    size_t cap;
+    long long files, invalid, failed;
+};
+
+static const char *files_next(void *arg)
+{
+    struct files_arg *fa = arg;
+
+    if (fa->paths)
+        return fa->next < fa->npaths ? fa->paths[fa->next++] : NULL;
+
+    ssize_t n;
+    while ((n = getline(&fa->line, &fa->cap, stdin)) >= 0) {
+        if (n && fa->line[n-1] == '\n')
+            fa->line[--n] = '\0';
+        if (n)
+            return fa->line;
+    }
+    return NULL;
+}
+
+static void files_report(const char *path, long long err, void *arg)
+{
+    struct files_arg *fa = arg;
+
+    ++fa->files;
+    if (err == 0) {
+        printf("%s: valid\n", path);
+    } else if (err > 0) {
+        printf("%s: invalid at byte %lld\n", path, err - 1);
+        ++fa->invalid;
+    } else {
+        printf("%s: %s\n", path, strerror(-err));
+        ++fa->failed;
+    }
+}
+
+static int files(int argc, char *argv[])
+{
+    struct files_arg fa = { 0 };
+    unsigned int flags = 0;
+    struct timeval tv1, tv2;
+    double time;
+
+    if (argc && strcmp(argv[0], "-sync") == 0) {
+        flags |= BULK_SYNC;
+        --argc;
+        ++argv;
+    }
+    if (argc) {
+        fa.paths = argv;
+        fa.npaths = argc;
+    }
+
+    gettimeofday(&tv1, 0);
+    if (bulk_validate(files_next, files_report, &fa, flags)) {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    gettimeofday(&tv2, 0);
+    free(fa.line);
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    fprintf(stderr, "%lld files, %lld invalid, %lld failed, %.4f s\n",
+            fa.files, fa.invalid, fa.failed, time);
+
+    return fa.invalid || fa.failed;
+}
+
+static void scan_report(const char *path, long long err, long long line,
+                        long long column, void *arg)
+{
+    if (err > 0)
+        printf("%s:%lld:%lld: invalid UTF-8 at byte %lld\n",
+               path, line, column, err - 1);
+    else
+        fprintf(stderr, "%s: %s\n", path, strerror(-err));
+}
+
+static int scan(int argc, char *argv[])
+{
+    struct scan_opts opts = { 0 };
+    struct scan_stats stats, total = { 0 };
+    struct timeval tv1, tv2;
+    double time;
+
+    if (argc >= 2 && strcmp(argv[0], "-j") == 0) {
+        opts.threads = atoi(argv[1]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc == 0)
+        return -1;
+
+    gettimeofday(&tv1, 0);
+    for (int i = 0; i < argc; ++i) {
+        if (scan_tree(argv[i], &opts, scan_report, NULL, &stats)) {
+            fprintf(stderr, "Out of memory\n");
+            return 2;
+        }
+        total.files += stats.files;
+        total.dirs += stats.dirs;
+        total.bytes += stats.bytes;
+        total.invalid += stats.invalid;
+        total.failed += stats.failed;
+    }
+    gettimeofday(&tv2, 0);
+
+    time = tv2.tv_usec - tv1.tv_usec;
+    time = time / 1000000 + tv2.tv_sec - tv1.tv_sec;
+    fprintf(stderr, "%lld files, %lld dirs, %lld invalid, %lld failed\n",
+            total.files, total.dirs, total.invalid, total.failed);
+    fprintf(stderr, "time: %.4f s, %.0f files/s, %.2f GB/s\n", time,
+            total.files / time, total.bytes / time / 1e9);
+
+    return total.invalid || total.failed;
+}
+
+static int filter(void)
+{
+    const long long ret = filter_fd(STDIN_FILENO, STDOUT_FILENO);
+
+    if (ret > 0)
+        fprintf(stderr, "invalid UTF-8 at byte %lld\n", ret - 1);
+    else if (ret < 0)
+        fprintf(stderr, "%s\n", strerror(-ret));
+
+    return ret != 0;
+}
+
+static void usage(const char *bin)
+{
+    printf("Usage:\n");
+    printf("%s test  [alg]      ==> test all or one algorithm\n", bin);
+    printf("%s bench [alg]      ==> benchmark all or one algorithm\n", bin);
+    printf("%s bench size NUM   ==> benchmark with specific buffer size\n", bin);
+    printf("%s bench cache [KB]\n"
+           "                    ==> validate out of cache buffer, latency of\n"
+           "                        a workload on KB hot set, half L2 by "
+           "default\n", bin);
+    printf("%s files [-sync] [FILE]...\n"
+           "                    ==> validate files, paths from stdin if none,\n"
+           "                        -sync: open/read/close, no io_uring\n", bin);
+    printf("%s scan [-j N] DIR...\n"
+           "                    ==> validate files under DIR by N threads,\n"
+           "                        one per CPU by default\n", bin);
+    printf("%s filter           ==> copy stdin to stdout, "
+           "stop at first error\n", bin);
+    printf("alg = ");
+    for (int i = 0; i < ftab_size; ++i)
+        printf("%s ", ftab[i].name);
+    printf("\nNUM = buffer size in bytes, 1 ~ 67108864(64M)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int len = 0;
+    unsigned char *data;
+    const char *alg = NULL;
+    int (*tb)(const unsigned char *data, int len, const struct ftab *ftab);
+
+    if (argc >= 2 && strcmp(argv[1], "files") == 0)
+        return files(argc - 2, argv + 2);
+    if (argc == 2 && strcmp(argv[1], "filter") == 0)
+        return filter();
+    if (argc >= 2 && strcmp(argv[1], "scan") == 0) {
+        const int ret = scan(argc - 2, argv + 2);
+
+        if (ret >= 0)
+            return ret;
+        usage(argv[0]);
+        return 1;
+    }
+
+    tb = NULL;
+    if (argc >= 2) {
+        if (strcmp(argv[1], "test") == 0)
+            tb = test;
+        else if (strcmp(argv[1], "bench") == 0)
+            tb = bench;
+        if (argc >= 3) {
+            alg = argv[2];
+            if (tb == bench && strcmp(alg, "cache") == 0) {
+                long hot = argc >= 4 ? atol(argv[3]) * 1024 :
+                           sysconf(_SC_LEVEL2_CACHE_SIZE) / 2;
+
+                if (hot <= 0)
+                    hot = 512 * 1024;
+                data = load_test_file(&len);
+                return bench_cache(data, len, hot);
+            }
+            if (strcmp(alg, "size") == 0) {
+                if (argc < 4) {
+                    tb = NULL;
+                } else {
+                    alg = NULL;
+                    len = atoi(argv[3]);
+                    if (len <= 0 || len > 67108864) {
+                        printf("Buffer size error!\n\n");
+                        tb = NULL;
+                    }
+                }
+            }
+        }
+    }
+
+    if (tb == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Load UTF8 test buffer */
+    if (len)
+        data = load_test_buf(len);
+    else
+        data = load_test_file(&len);
+
+    int ret = 0;
     if (tb == bench)
         printf("=============== Bench UTF8 (%d bytes) ===============\n", len);
-    for (int i = 0; i < sizeof(ftab)/sizeof(ftab[0]); ++i) {
+    for (int i = 0; i < ftab_size; ++i) {
         if (alg && strcmp(alg, ftab[i].name) != 0)
             continue;
         ret |= tb((const unsigned char *)data, len, &ftab[i]);
         printf("\n");
     }
 
+    /* NUL terminated string kernels */
+    if (tb == bench && !alg) {
+        const struct ftab_cstr strlen_validate = {
+            .name = "strlen+utf8range",
+            .func = utf8_strlen_validate,
+        };
+        char *str = malloc(len + 1);
+
+        memcpy(str, data, len);
+        str[len] = 0;
+        printf("=============== Bench C string ===============\n");
+        bench_cstr(str, len, &strlen_validate);
+        printf("\n");
+        for (int i = 0; i < ftab_cstr_size; ++i) {
+            bench_cstr(str, len, &ftab_cstr[i]);
+            printf("\n");
+        }
+        free(str);
+
+        const struct ftab_count validate_then_count = {
+            .name = "utf8range+count",
+            .func = utf8_validate_then_count,
+        };
+        printf("=============== Bench count ===============\n");
+        bench_count(data, len, &validate_then_count);
+        printf("\n");
+        for (int i = 0; i < ftab_count_size; ++i) {
+            bench_count(data, len, &ftab_count[i]);
+            printf("\n");
+        }
+
+        const struct ftab_json validate_then_json = {
+            .name = "utf8range+json",
+            .func = utf8_validate_then_json,
+        };
+        printf("=============== Bench JSON escapes ===============\n");
+        bench_json(data, len, &validate_then_json);
+        printf("\n");
+        for (int i = 0; i < ftab_json_size; ++i) {
+            bench_json(data, len, &ftab_json[i]);
+            printf("\n");
+        }
+
+        const struct ftab_lines validate_then_memchr = {
+            .name = "utf8range+memchr",
+            .func = utf8_validate_then_memchr,
+        };
+        printf("=============== Bench lines ===============\n");
+        bench_lines(data, len, &validate_then_memchr);
+        printf("\n");
+        for (int i = 0; i < ftab_lines_size; ++i) {
+            bench_lines(data, len, &ftab_lines[i]);
+            printf("\n");
+        }
+
+        printf("=============== Bench iovec ===============\n");
+        bench_iov(data, len, 1);
+        printf("\n");
+        bench_iov(data, len, 0);
+        printf("\n");
+
+        printf("=============== Bench revalidate ===============\n");
+        bench_revalidate(data, len);
+        printf("\n");
+
+        printf("=============== Bench skip chars ===============\n");
+        for (int i = 0; i < ftab_skip_size; ++i) {
+            bench_skip(data, len, &ftab_skip[i]);
+            printf("\n");
+        }
+
+        printf("=============== Bench index ===============\n");
+        for (int i = 0; i < ftab_index_size; ++i) {
+            bench_index(data, len, &ftab_index[i]);
+            printf("\n");
+        }
+
+        /* All policies, CONTROL allows TAB, LF, CR of test files */
+        const unsigned int policy = UTF8_POLICY_NUL | UTF8_POLICY_C1 |
+            UTF8_POLICY_NONCHAR | UTF8_POLICY_PRIVATE | UTF8_POLICY_CONTROL;
+        printf("=============== Bench policy %02x ===============\n", policy);
+        for (int i = 0; i < ftab_policy_size; ++i) {
+            bench_policy(data, len, &ftab_policy[i], policy);
+            printf("\n");
+        }
+
+        /* UTF-8 is also WTF-8 */
+        printf("=============== Bench WTF-8 ===============\n");
+        for (int i = 0; i < ftab_wtf8_size; ++i) {
+            bench(data, len, &ftab_wtf8[i]);
+            printf("\n");
+        }
+
+        /* Test buffer re-encoded, valid CESU-8 if there's no NUL */
+        int len_mutf8;
+        unsigned char *mutf8 = to_mutf8(data, len, &len_mutf8);
+
+        printf("=============== Bench MUTF-8 (%d bytes) ===============\n",
+               len_mutf8);
+        for (int i = 0; i < ftab_cesu8_size; ++i) {
+            bench(mutf8, len_mutf8, &ftab_cesu8[i]);
+            printf("\n");
+        }
+        for (int i = 0; i < ftab_mutf8_size; ++i) {
+            bench(mutf8, len_mutf8, &ftab_mutf8[i]);
+            printf("\n");
+        }
+        for (int i = 0; i < ftab_mutf8_conv_size; ++i) {
+            bench_conv(mutf8, len_mutf8, &ftab_mutf8_conv[i]);
+            printf("\n");
+        }
+        free(mutf8);
+    } else if (tb == test) {
+        for (int i = 0; i < ftab_count_size; ++i) {
+            if (alg && strcmp(alg, ftab_count[i].name) != 0)
+                continue;
+            int ret_count = test_count(&ftab_count[i]);
+            printf("%s\n", ftab_count[i].name);
+            printf("count test: %s\n\n", ret_count ? "FAIL" : "pass");
+            ret |= ret_count;
+        }
+        for (int i = 0; i < ftab_index_size; ++i) {
+            if (alg && strcmp(alg, ftab_index[i].name) != 0)
+                continue;
+            int ret_index = test_index(&ftab_index[i]);
+            printf("%s\n", ftab_index[i].name);
+            printf("index test: %s\n\n", ret_index ? "FAIL" : "pass");
+            ret |= ret_index;
+        }
+        for (int i = 0; i < ftab_skip_size; ++i) {
+            if (alg && strcmp(alg, ftab_skip[i].name) != 0)
+                continue;
+            int ret_skip = test_skip(&ftab_skip[i]);
+            printf("%s\n", ftab_skip[i].name);
+            printf("skip test: %s\n\n", ret_skip ? "FAIL" : "pass");
+            ret |= ret_skip;
+        }
+        for (int i = 0; i < ftab_json_size; ++i) {
+            if (alg && strcmp(alg, ftab_json[i].name) != 0)
+                continue;
+            int ret_json = test_json(&ftab_json[i]);
+            printf("%s\n", ftab_json[i].name);
+            printf("json test: %s\n\n", ret_json ? "FAIL" : "pass");
+            ret |= ret_json;
+        }
+        for (int i = 0; i < ftab_lines_size; ++i) {
+            if (alg && strcmp(alg, ftab_lines[i].name) != 0)
+                continue;
+            int ret_lines = test_lines(&ftab_lines[i]);
+            printf("%s\n", ftab_lines[i].name);
+            printf("lines test: %s\n\n", ret_lines ? "FAIL" : "pass");
+            ret |= ret_lines;
+        }
+        if (!alg) {
+            int ret_truncate = test_truncate();
+            printf("truncate test: %s\n\n", ret_truncate ? "FAIL" : "pass");
+            ret |= ret_truncate;
+
+            int ret_revalidate = test_revalidate();
+            printf("revalidate test: %s\n\n",
+                   ret_revalidate ? "FAIL" : "pass");
+            ret |= ret_revalidate;
+
+            int ret_stream = test_char_bufs(test_stream_buf, NULL);
+            printf("stream test: %s\n\n", ret_stream ? "FAIL" : "pass");
+            ret |= ret_stream;
+
+            int ret_iov = test_char_bufs(test_iov_buf, NULL);
+            printf("iov test: %s\n\n", ret_iov ? "FAIL" : "pass");
+            ret |= ret_iov;
+
+            int ret_ring = test_char_bufs(test_ring_buf, NULL);
+            printf("ring test: %s\n\n", ret_ring ? "FAIL" : "pass");
+            ret |= ret_ring;
+
+            int ret_bulk = test_bulk();
+            printf("bulk test: %s\n\n", ret_bulk ? "FAIL" : "pass");
+            ret |= ret_bulk;
+
+            int ret_scan = test_scan();
+            printf("scan test: %s\n\n", ret_scan ? "FAIL" : "pass");
+            ret |= ret_scan;
+
+            int ret_filter = test_filter();
+            printf("filter test: %s\n\n", ret_filter ? "FAIL" : "pass");
+            ret |= ret_filter;
+        }
+        for (int i = 0; i < ftab_cstr_size; ++i) {
+            if (alg && strcmp(alg, ftab_cstr[i].name) != 0)
+                continue;
+            int ret_cstr = test_cstr(&ftab_cstr[i]);
+            printf("%s\n", ftab_cstr[i].name);
+            printf("cstr test: %s\n\n", ret_cstr ? "FAIL" : "pass");
+            ret |= ret_cstr;
+        }
+        for (int i = 0; i < ftab_policy_size; ++i) {
+            if (alg && strcmp(alg, ftab_policy[i].name) != 0)
+                continue;
+            int ret_policy = test_policy(&ftab_policy[i]);
+            printf("%s\n", ftab_policy[i].name);
+            printf("policy test: %s\n\n", ret_policy ? "FAIL" : "pass");
+            ret |= ret_policy;
+        }
+        for (int i = 0; i < ftab_cesu8_size; ++i) {
+            if (alg && strcmp(alg, ftab_cesu8[i].name) != 0)
+                continue;
+            int ret_cesu8 = test_cesu8(&ftab_cesu8[i], ref_cesu8);
+            printf("%s\n", ftab_cesu8[i].name);
+            printf("cesu8 test: %s\n\n", ret_cesu8 ? "FAIL" : "pass");
+            ret |= ret_cesu8;
+        }
+        for (int i = 0; i < ftab_mutf8_size; ++i) {
+            if (alg && strcmp(alg, ftab_mutf8[i].name) != 0)
+                continue;
+            int ret_mutf8 = test_cesu8(&ftab_mutf8[i], ref_mutf8);
+            printf("%s\n", ftab_mutf8[i].name);
+            printf("mutf8 test: %s\n\n", ret_mutf8 ? "FAIL" : "pass");
+            ret |= ret_mutf8;
+        }
+        for (int i = 0; i < ftab_wtf8_size; ++i) {
+            if (alg && strcmp(alg, ftab_wtf8[i].name) != 0)
+                continue;
+            int ret_manual = test_wtf8_manual(&ftab_wtf8[i]);
+            int ret_boundary = test_wtf8_boundary(&ftab_wtf8[i]);
+            printf("%s\n", ftab_wtf8[i].name);
+            printf("wtf8 manual test: %s\n", ret_manual ? "FAIL" : "pass");
+            printf("wtf8 boundary test: %s\n\n",
+                   ret_boundary ? "FAIL" : "pass");
+            ret |= ret_manual | ret_boundary;
+        }
+        for (int i = 0; i < ftab_mutf8_conv_size; ++i) {
+            if (alg && strcmp(alg, ftab_mutf8_conv[i].name) != 0)
+                continue;
+            int ret_conv = test_mutf8_conv(&ftab_mutf8_conv[i]);
+            printf("%s\n", ftab_mutf8_conv[i].name);
+            printf("conversion test: %s\n\n", ret_conv ? "FAIL" : "pass");
+            ret |= ret_conv;
+        }
+    }
+
 #if 0
     if (tb == bench) {
         printf("==================== Bench ASCII ====================\n");
@@ -390,7 +3109,7 @@ int main(int argc, char *argv[])
         for (int i = 0; i < len; i++)
             data[i] &= 0x7F;
 
-        for (int i = 0; i < sizeof(ftab)/sizeof(ftab[0]); ++i) {
+        for (int i = 0; i < ftab_size; ++i) {
             if (alg && strcmp(alg, ftab[i].name) != 0)
                 continue;
             tb((const unsigned char *)data, len, &ftab[i]);
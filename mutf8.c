@@ -0,0 +1,159 @@
+#include <stdio.h>
+
+/*
+ * CESU-8 and Java Modified UTF-8 (MUTF-8)
+ * https://www.unicode.org/reports/tr26/
+ * https://docs.oracle.com/javase/8/docs/api/java/io/DataInput.html
+ *
+ * Supplementary characters are encoded as surrogate pairs, each surrogate in
+ * 3 bytes, there's no 4 bytes sequence. MUTF-8 additionally encodes U+0000 as
+ * C0 80, byte 00 never appears.
+ *
+ * +--------------------+------------+-------------+------------+
+ * | Code Points        | First Byte | Second Byte | Third Byte |
+ * +--------------------+------------+-------------+------------+
+ * | U+0000 (MUTF-8)    | C0         | 80          |            |
+ * +--------------------+------------+-------------+------------+
+ * | U+0000..U+007F     | 00..7F     |             |            |
+ * | (MUTF-8)           | 01..7F     |             |            |
+ * +--------------------+------------+-------------+------------+
+ * | U+0080..U+07FF     | C2..DF     | 80..BF      |            |
+ * +--------------------+------------+-------------+------------+
+ * | U+0800..U+0FFF     | E0         | A0..BF      | 80..BF     |
+ * +--------------------+------------+-------------+------------+
+ * | U+1000..U+CFFF     | E1..EC     | 80..BF      | 80..BF     |
+ * +--------------------+------------+-------------+------------+
+ * | U+D000..U+D7FF     | ED         | 80..9F      | 80..BF     |
+ * +--------------------+------------+-------------+------------+
+ * | U+D800..U+DBFF     | ED         | A0..AF      | 80..BF     |
+ * | followed by        | ED         | B0..BF      | 80..BF     |
+ * | U+DC00..U+DFFF     |            |             |            |
+ * +--------------------+------------+-------------+------------+
+ * | U+E000..U+FFFF     | EE..EF     | 80..BF      | 80..BF     |
+ * +--------------------+------------+-------------+------------+
+ *
+ * A surrogate pair is taken as one char of 6 bytes. Unpaired surrogates are
+ * ill-formed, error index points to the high surrogate of a broken pair.
+ */
+
+#define IS_CONT(b)  (((b) & 0xC0) == 0x80)
+
+/* Bytes of well-formed char at data, 0 if ill-formed or truncated */
+static int cesu8_char(const unsigned char *data, int len, int mutf8)
+{
+    const unsigned char byte1 = data[0];
+
+    if (byte1 <= 0x7F)
+        return (mutf8 && byte1 == 0) ? 0 : 1;
+
+    if (byte1 == 0xC0 && mutf8)
+        return (len >= 2 && data[1] == 0x80) ? 2 : 0;
+
+    if (byte1 >= 0xC2 && byte1 <= 0xDF)
+        return (len >= 2 && IS_CONT(data[1])) ? 2 : 0;
+
+    if (byte1 >= 0xE0 && byte1 <= 0xEF) {
+        if (len < 3 || !IS_CONT(data[1]) || !IS_CONT(data[2]))
+            return 0;
+        if (byte1 == 0xE0 && data[1] < 0xA0)
+            return 0;
+        if (byte1 == 0xED && data[1] >= 0xA0) {
+            /* High surrogate followed by low surrogate */
+            if (data[1] >= 0xB0 || len < 6 || data[3] != 0xED ||
+                    (data[4] & 0xF0) != 0xB0 || !IS_CONT(data[5]))
+                return 0;
+            return 6;
+        }
+        return 3;
+    }
+
+    return 0;
+}
+
+static int cesu8_naive(const unsigned char *data, int len, int mutf8)
+{
+    int err_pos = 1;
+
+    while (len) {
+        const int bytes = cesu8_char(data, len, mutf8);
+
+        if (bytes == 0)
+            return err_pos;
+
+        len -= bytes;
+        err_pos += bytes;
+        data += bytes;
+    }
+
+    return 0;
+}
+
+/* Return 0 - success, >0 - index(1 based) of first error char */
+int utf8_cesu8_naive(const unsigned char *data, int len)
+{
+    return cesu8_naive(data, len, 0);
+}
+
+int utf8_mutf8_naive(const unsigned char *data, int len)
+{
+    return cesu8_naive(data, len, 1);
+}
+
+/*
+ * MUTF-8 to UTF-8
+ * Parameters:
+ * - src, len: input MUTF-8 string
+ * - dst: buffer to store UTF-8 string, never longer than input
+ * - *dst_len: on entry - buffer length
+ *             on exit  - length of valid converted UTF-8 string
+ * Returns:
+ *  -  0: success
+ *  - >0: error position of input MUTF-8 string
+ *  - -1: output buffer overflow
+ */
+int utf8_mutf8_to_utf8_naive(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len)
+{
+    int err_pos = 1;
+    size_t left = *dst_len;
+
+    *dst_len = 0;
+
+    while (len) {
+        const int bytes = cesu8_char(src, len, 1);
+        int out;
+
+        if (bytes == 0)
+            return err_pos;
+
+        /* Output is 1 byte for C0 80, 4 bytes for surrogate pair */
+        out = bytes == 6 ? 4 : src[0] == 0xC0 ? 1 : bytes;
+        if (left < out)
+            return -1;
+
+        if (bytes == 6) {
+            const unsigned int u = 0x10000 +
+                (((src[1] & 0x0F) << 16) | ((src[2] & 0x3F) << 10) |
+                 ((src[4] & 0x0F) << 6) | (src[5] & 0x3F));
+
+            dst[0] = 0xF0 | (u >> 18);
+            dst[1] = 0x80 | ((u >> 12) & 0x3F);
+            dst[2] = 0x80 | ((u >> 6) & 0x3F);
+            dst[3] = 0x80 | (u & 0x3F);
+        } else if (src[0] == 0xC0) {
+            dst[0] = 0;
+        } else {
+            for (int i = 0; i < bytes; ++i)
+                dst[i] = src[i];
+        }
+
+        src += bytes;
+        len -= bytes;
+        err_pos += bytes;
+        dst += out;
+        *dst_len += out;
+        left -= out;
+    }
+
+    return 0;
+}
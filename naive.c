@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 
 /*
  * http://www.unicode.org/versions/Unicode6.0.0/ch03.pdf - page 94
@@ -28,6 +30,22 @@
  * +--------------------+------------+-------------+------------+-------------+
  */
 
+/* Leading ascii bytes of 8 bytes at p, like ascii_u64_find() in ascii.cpp */
+static inline int ascii_word(const unsigned char *p)
+{
+    uint64_t w;
+
+    memcpy(&w, p, 8);
+    w &= 0x8080808080808080ULL;
+    if (w == 0)
+        return 8;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clzll(w) / 8;
+#else
+    return __builtin_ctzll(w) / 8;
+#endif
+}
+
 /* Return 0 - success,  >0 - index(1 based) of first error char */
 int utf8_naive(const unsigned char *data, int len)
 {
@@ -39,7 +57,17 @@ int utf8_naive(const unsigned char *data, int len)
 
         /* 00..7F */
         if (byte1 <= 0x7F) {
-            bytes = 1;
+            /* Whole ascii run a word at a time, short tail bytewise */
+            bytes = 0;
+            while (len - bytes >= 8) {
+                const int n = ascii_word(data + bytes);
+
+                bytes += n;
+                if (n < 8)
+                    break;
+            }
+            while (bytes < len && data[bytes] <= 0x7F)
+                ++bytes;
         /* C2..DF, 80..BF */
         } else if (len >= 2 && byte1 >= 0xC2 && byte1 <= 0xDF &&
                 (signed char)data[1] <= (signed char)0xBF) {
@@ -90,3 +118,21 @@ int utf8_naive(const unsigned char *data, int len)
 
     return 0;
 }
+
+/*
+ * Validate and count chars
+ * Return same as utf8_naive(), *count - chars before first error char
+ */
+int utf8_naive_count(const unsigned char *data, int len, size_t *count)
+{
+    const int err = utf8_naive(data, len);
+    const int valid = err ? err - 1 : len;
+    size_t n = 0;
+
+    /* Chars of well-formed string are bytes other than 80..BF */
+    for (int i = 0; i < valid; ++i)
+        n += (signed char)data[i] > (signed char)0xBF;
+
+    *count = n;
+    return err;
+}
@@ -0,0 +1,60 @@
+#include "utf8range.h"
+
+int utf8_naive(const unsigned char *data, int len);
+
+/* Is code point rejected by policy */
+static int policy_reject(unsigned int u, unsigned int policy)
+{
+    if ((policy & UTF8_POLICY_NUL) && u == 0)
+        return 1;
+    if ((policy & UTF8_POLICY_CONTROL) &&
+            ((u < 0x20 && u != '\t' && u != '\n' && u != '\r') || u == 0x7F))
+        return 1;
+    if ((policy & UTF8_POLICY_C1) && u >= 0x80 && u <= 0x9F)
+        return 1;
+    if ((policy & UTF8_POLICY_NONCHAR) &&
+            ((u >= 0xFDD0 && u <= 0xFDEF) || (u & 0xFFFE) == 0xFFFE))
+        return 1;
+    if ((policy & UTF8_POLICY_PRIVATE) &&
+            ((u >= 0xE000 && u <= 0xF8FF) || u >= 0xF0000))
+        return 1;
+    return 0;
+}
+
+/*
+ * Validate char by char with utf8_naive, then check decoded code point
+ * Return 0 - success, >0 - index(1 based) of first ill-formed or rejected char
+ */
+int utf8_policy_naive(const unsigned char *data, int len, unsigned int policy)
+{
+    int err_pos = 1;
+
+    while (len) {
+        const unsigned char byte1 = data[0];
+        unsigned int u;
+        int bytes;
+
+        if (byte1 <= 0x7F)
+            bytes = 1, u = byte1;
+        else if (byte1 <= 0xDF)
+            bytes = 2, u = byte1 & 0x1F;
+        else if (byte1 <= 0xEF)
+            bytes = 3, u = byte1 & 0x0F;
+        else
+            bytes = 4, u = byte1 & 0x07;
+
+        if (bytes > len || utf8_naive(data, bytes))
+            return err_pos;
+
+        for (int i = 1; i < bytes; ++i)
+            u = (u << 6) | (data[i] & 0x3F);
+        if (policy_reject(u, policy))
+            return err_pos;
+
+        len -= bytes;
+        err_pos += bytes;
+        data += bytes;
+    }
+
+    return 0;
+}
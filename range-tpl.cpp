@@ -0,0 +1,363 @@
+/*
+ * Range algorithm generated from single source range.h
+ * - range:  one vector per iteration, utf8_range() (SSE4 or NEON),
+ *   utf8_range_avx2(), utf8_range_avx512()
+ * - range2: two vectors per iteration, utf8_range2(), utf8_range2_avx2(),
+ *   utf8_range2_avx512()
+ * - range2_nt, range_avx2_nt: large buffer mode, see RANGE_NT
+ * - range_count: validate and count chars, see range_validate_count()
+ * - range_index: validate and build sparse char index, index lookup
+ * - range_skip_chars: byte offset of k-th char, see range_skip_chars()
+ * - range_json: validate and find JSON escapes, see range_validate_json()
+ * - range_lines: split and validate lines, see range_validate_lines()
+ * - range_cstr: NUL terminated string, see range_validate_cstr()
+ * - range_policy: reject code points per policy, see range_validate_policy()
+ * - range_cesu8, range_mutf8: CESU-8 and Modified UTF-8, see mutf8.c
+ * - range_mutf8_to_utf8: convert Modified UTF-8 to UTF-8
+ * - range_wtf8: WTF-8, see wtf8.c
+ */
+#include "range.h"
+
+#if defined(__x86_64__)
+
+/* Return 0 on success, -1 on error */
+extern "C" int utf8_range(const unsigned char *data, int len)
+{
+    return range_validate<Sse, 1>(data, len);
+}
+
+extern "C" int utf8_range2(const unsigned char *data, int len)
+{
+    return range_validate<Sse, 2>(data, len);
+}
+
+/* For buffers much bigger than LLC, validated once */
+extern "C" int utf8_range2_nt(const unsigned char *data, int len)
+{
+    return range_validate<Sse, 2, false, RANGE_NT>(data, len);
+}
+
+extern "C" int utf8_range_count(const unsigned char *data, int len,
+                                 size_t *count)
+{
+    return range_validate_count<Sse>(data, len, count);
+}
+
+extern "C" int utf8_range_index(const unsigned char *data, int len,
+                                int *index, size_t *count)
+{
+    return range_validate_index<Sse>(data, len, index, count);
+}
+
+extern "C" int utf8_range_index_offset(const unsigned char *data,
+        int len, const int *index, size_t count, size_t k)
+{
+    return range_index_offset<Sse>(data, len, index, count, k);
+}
+
+extern "C" int utf8_range_skip_chars(const unsigned char *data, int len,
+                                     size_t k)
+{
+    return range_skip_chars<Sse>(data, len, k);
+}
+
+extern "C" int utf8_range_json(const unsigned char *data, int len,
+                               uint64_t *mask, size_t *escapes)
+{
+    return range_validate_json<Sse>(data, len, mask, escapes);
+}
+
+extern "C" int utf8_range_lines(const unsigned char *data, int len,
+        const char *delims, int *ends, int *errors, int max_lines)
+{
+    return range_validate_lines<Sse>(data, len, delims, ends, errors,
+                                    max_lines);
+}
+
+extern "C" int utf8_range_cstr(const char *str, size_t *len)
+{
+    return range_validate_cstr<Sse>(str, len);
+}
+
+extern "C" int utf8_range_policy(const unsigned char *data, int len,
+                                 unsigned int policy)
+{
+    return range_validate_policy<Sse>(data, len, policy);
+}
+
+extern "C" int utf8_range_cesu8(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Sse, false>(data, len);
+}
+
+extern "C" int utf8_range_mutf8(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Sse, true>(data, len);
+}
+
+extern "C" int utf8_range_mutf8_to_utf8(const unsigned char *src,
+        size_t len, unsigned char *dst, size_t *dst_len)
+{
+    return range_mutf8_to_utf8<Sse>(src, len, dst, dst_len);
+}
+
+extern "C" int utf8_range_wtf8(const unsigned char *data, int len)
+{
+    return range_validate_wtf8<Sse>(data, len);
+}
+
+#ifdef __AVX2__
+extern "C" int utf8_range_avx2(const unsigned char *data, int len)
+{
+    return range_validate<Avx2, 1>(data, len);
+}
+
+extern "C" int utf8_range_avx2_nt(const unsigned char *data, int len)
+{
+    return range_validate<Avx2, 1, false, RANGE_NT>(data, len);
+}
+
+extern "C" int utf8_range2_avx2(const unsigned char *data, int len)
+{
+    return range_validate<Avx2, 2>(data, len);
+}
+
+extern "C" int utf8_range_count_avx2(const unsigned char *data, int len,
+                                      size_t *count)
+{
+    return range_validate_count<Avx2>(data, len, count);
+}
+
+extern "C" int utf8_range_index_avx2(const unsigned char *data, int len,
+                                     int *index, size_t *count)
+{
+    return range_validate_index<Avx2>(data, len, index, count);
+}
+
+extern "C" int utf8_range_index_offset_avx2(const unsigned char *data,
+        int len, const int *index, size_t count, size_t k)
+{
+    return range_index_offset<Avx2>(data, len, index, count, k);
+}
+
+extern "C" int utf8_range_skip_chars_avx2(const unsigned char *data, int len,
+                                          size_t k)
+{
+    return range_skip_chars<Avx2>(data, len, k);
+}
+
+extern "C" int utf8_range_json_avx2(const unsigned char *data, int len,
+                                    uint64_t *mask, size_t *escapes)
+{
+    return range_validate_json<Avx2>(data, len, mask, escapes);
+}
+
+extern "C" int utf8_range_lines_avx2(const unsigned char *data, int len,
+        const char *delims, int *ends, int *errors, int max_lines)
+{
+    return range_validate_lines<Avx2>(data, len, delims, ends, errors,
+                                    max_lines);
+}
+
+extern "C" int utf8_range_cstr_avx2(const char *str, size_t *len)
+{
+    return range_validate_cstr<Avx2>(str, len);
+}
+
+extern "C" int utf8_range_policy_avx2(const unsigned char *data, int len,
+                                      unsigned int policy)
+{
+    return range_validate_policy<Avx2>(data, len, policy);
+}
+
+extern "C" int utf8_range_cesu8_avx2(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Avx2, false>(data, len);
+}
+
+extern "C" int utf8_range_mutf8_avx2(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Avx2, true>(data, len);
+}
+
+extern "C" int utf8_range_mutf8_to_utf8_avx2(const unsigned char *src,
+        size_t len, unsigned char *dst, size_t *dst_len)
+{
+    return range_mutf8_to_utf8<Avx2>(src, len, dst, dst_len);
+}
+
+extern "C" int utf8_range_wtf8_avx2(const unsigned char *data, int len)
+{
+    return range_validate_wtf8<Avx2>(data, len);
+}
+#endif
+
+#ifdef __AVX512BW__
+extern "C" int utf8_range_avx512(const unsigned char *data, int len)
+{
+    return range_validate<Avx512, 1>(data, len);
+}
+
+extern "C" int utf8_range2_avx512(const unsigned char *data, int len)
+{
+    return range_validate<Avx512, 2>(data, len);
+}
+
+extern "C" int utf8_range_count_avx512(const unsigned char *data, int len,
+                                        size_t *count)
+{
+    return range_validate_count<Avx512>(data, len, count);
+}
+
+extern "C" int utf8_range_index_avx512(const unsigned char *data, int len,
+                                       int *index, size_t *count)
+{
+    return range_validate_index<Avx512>(data, len, index, count);
+}
+
+extern "C" int utf8_range_index_offset_avx512(const unsigned char *data,
+        int len, const int *index, size_t count, size_t k)
+{
+    return range_index_offset<Avx512>(data, len, index, count, k);
+}
+
+extern "C" int utf8_range_skip_chars_avx512(const unsigned char *data, int len,
+                                            size_t k)
+{
+    return range_skip_chars<Avx512>(data, len, k);
+}
+
+extern "C" int utf8_range_json_avx512(const unsigned char *data, int len,
+                                      uint64_t *mask, size_t *escapes)
+{
+    return range_validate_json<Avx512>(data, len, mask, escapes);
+}
+
+extern "C" int utf8_range_lines_avx512(const unsigned char *data, int len,
+        const char *delims, int *ends, int *errors, int max_lines)
+{
+    return range_validate_lines<Avx512>(data, len, delims, ends, errors,
+                                    max_lines);
+}
+
+extern "C" int utf8_range_cstr_avx512(const char *str, size_t *len)
+{
+    return range_validate_cstr<Avx512>(str, len);
+}
+
+extern "C" int utf8_range_policy_avx512(const unsigned char *data, int len,
+                                        unsigned int policy)
+{
+    return range_validate_policy<Avx512>(data, len, policy);
+}
+
+extern "C" int utf8_range_cesu8_avx512(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Avx512, false>(data, len);
+}
+
+extern "C" int utf8_range_mutf8_avx512(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Avx512, true>(data, len);
+}
+
+extern "C" int utf8_range_mutf8_to_utf8_avx512(const unsigned char *src,
+        size_t len, unsigned char *dst, size_t *dst_len)
+{
+    return range_mutf8_to_utf8<Avx512>(src, len, dst, dst_len);
+}
+
+extern "C" int utf8_range_wtf8_avx512(const unsigned char *data, int len)
+{
+    return range_validate_wtf8<Avx512>(data, len);
+}
+#endif
+
+#elif defined(__aarch64__)
+
+extern "C" int utf8_range(const unsigned char *data, int len)
+{
+    return range_validate<Neon, 1>(data, len);
+}
+
+extern "C" int utf8_range2(const unsigned char *data, int len)
+{
+    return range_validate<Neon, 2>(data, len);
+}
+
+/* For buffers much bigger than LLC, validated once */
+extern "C" int utf8_range2_nt(const unsigned char *data, int len)
+{
+    return range_validate<Neon, 2, false, RANGE_NT>(data, len);
+}
+
+extern "C" int utf8_range_count(const unsigned char *data, int len,
+                                 size_t *count)
+{
+    return range_validate_count<Neon>(data, len, count);
+}
+
+extern "C" int utf8_range_index(const unsigned char *data, int len,
+                                int *index, size_t *count)
+{
+    return range_validate_index<Neon>(data, len, index, count);
+}
+
+extern "C" int utf8_range_index_offset(const unsigned char *data,
+        int len, const int *index, size_t count, size_t k)
+{
+    return range_index_offset<Neon>(data, len, index, count, k);
+}
+
+extern "C" int utf8_range_skip_chars(const unsigned char *data, int len,
+                                     size_t k)
+{
+    return range_skip_chars<Neon>(data, len, k);
+}
+
+extern "C" int utf8_range_json(const unsigned char *data, int len,
+                               uint64_t *mask, size_t *escapes)
+{
+    return range_validate_json<Neon>(data, len, mask, escapes);
+}
+
+extern "C" int utf8_range_lines(const unsigned char *data, int len,
+        const char *delims, int *ends, int *errors, int max_lines)
+{
+    return range_validate_lines<Neon>(data, len, delims, ends, errors,
+                                    max_lines);
+}
+
+extern "C" int utf8_range_cstr(const char *str, size_t *len)
+{
+    return range_validate_cstr<Neon>(str, len);
+}
+
+extern "C" int utf8_range_policy(const unsigned char *data, int len,
+                                 unsigned int policy)
+{
+    return range_validate_policy<Neon>(data, len, policy);
+}
+
+extern "C" int utf8_range_cesu8(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Neon, false>(data, len);
+}
+
+extern "C" int utf8_range_mutf8(const unsigned char *data, int len)
+{
+    return range_validate_cesu8<Neon, true>(data, len);
+}
+
+extern "C" int utf8_range_mutf8_to_utf8(const unsigned char *src,
+        size_t len, unsigned char *dst, size_t *dst_len)
+{
+    return range_mutf8_to_utf8<Neon>(src, len, dst, dst_len);
+}
+
+extern "C" int utf8_range_wtf8(const unsigned char *data, int len)
+{
+    return range_validate_wtf8<Neon>(data, len);
+}
+
+#endif
@@ -0,0 +1,1182 @@
+/*
+ * Range algorithm written once for all ISAs (C++)
+ * See README.md for a step by step example, simd.h for supported ISAs.
+ *
+ * Range<V> validates one vector at a time and carries the state between
+ * vectors. range_validate<V, U>() is the complete kernel, processing U
+ * vectors in each iteration. Remaining bytes are passed to narrower vectors
+ * (AVX512 -> AVX2 -> SSE4) before falling back to SWAR method.
+ */
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stddef.h>
+
+#include "simd.h"
+#include "utf8range.h"
+
+extern "C" int utf8_swar(const unsigned char *data, int len);
+extern "C" int utf8_naive_count(const unsigned char *data, int len,
+                                size_t *count);
+extern "C" int utf8_policy_naive(const unsigned char *data, int len,
+                                 unsigned int policy);
+extern "C" int utf8_cesu8_naive(const unsigned char *data, int len);
+extern "C" int utf8_mutf8_naive(const unsigned char *data, int len);
+extern "C" int utf8_wtf8_naive(const unsigned char *data, int len);
+extern "C" int utf8_json_naive(const unsigned char *data, int len,
+                               uint64_t *mask, size_t *escapes);
+
+/*
+ * Tables of range algorithm
+ * - first_len, first_range: indexed by high nibble of First Byte
+ * - range_min, range_max: unsigned, illegal ranges have min 0xFF, max 0x00
+ * - c0_cf, df_ee, ef_fe: range index adjustment of Second Byte, indexed by
+ *   First Byte minus C0, DF, EF
+ * - e0_ff: same adjustment as df_ee and ef_fe, indexed by First Byte minus E0
+ *
+ * Each byte gets a range index, min and max of the index bound the byte.
+ * Index 0    : 00 ~ 7F (First Byte, ascii)
+ * Index 1,2,3: 80 ~ BF (Second, Third, Fourth Byte)
+ * Index 4    : A0 ~ BF (Second Byte after E0)
+ * Index 5    : 80 ~ 9F (Second Byte after ED)
+ * Index 6    : 90 ~ BF (Second Byte after F0)
+ * Index 7    : 80 ~ 8F (Second Byte after F4)
+ * Index 8    : C2 ~ F4 (First Byte, non ascii)
+ * Index 9~15 : illegal, overlapping First Bytes
+ *
+ * Second Byte after four special First Bytes (E0, ED, F0, F4) is not 80~BF,
+ * its range index is adjusted:
+ * +------------+---------------+------------------+----------------+
+ * | First Byte | original range| range adjustment | adjusted range |
+ * +------------+---------------+------------------+----------------+
+ * | E0         | 2             | 2                | 4              |
+ * | ED         | 2             | 3                | 5              |
+ * | F0         | 3             | 3                | 6              |
+ * | F4         | 4             | 4                | 8              |
+ * +------------+---------------+------------------+----------------+
+ */
+struct RangeTables {
+    uint8_t first_len[16];
+    uint8_t first_range[16];
+    uint8_t range_min[16];
+    uint8_t range_max[16];
+    uint8_t c0_cf[16];
+    uint8_t df_ee[16];
+    uint8_t ef_fe[16];
+    uint8_t e0_ff[32];
+};
+
+/* Standard UTF-8 */
+static const RangeTables range_utf8 = {
+    /* first_len */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 3 },
+    /* first_range */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 8, 8, 8 },
+    /* range_min */
+    { 0x00, 0x80, 0x80, 0x80, 0xA0, 0x80, 0x90, 0x80,
+      0xC2, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF },
+    /* range_max */
+    { 0x7F, 0xBF, 0xBF, 0xBF, 0xBF, 0x9F, 0xBF, 0x8F,
+      0xF4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    /* c0_cf */
+    { 0 },
+    /* df_ee: E0 -> 2, ED -> 3 */
+    { 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0 },
+    /* ef_fe: F0 -> 3, F4 -> 4 */
+    { 0, 3, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* e0_ff */
+    { 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0,
+      3, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+/* C0: also adjust Second Byte after C0~CF, costs 3 more operations */
+template <class V, bool C0 = false>
+class Range {
+public:
+    typedef typename V::vec vec;
+
+    explicit Range(const RangeTables &t)
+        : first_len_tbl(V::table(t.first_len)),
+          first_range_tbl(V::table(t.first_range)),
+          range_min_tbl(V::table(t.range_min)),
+          range_max_tbl(V::table(t.range_max)),
+          c0_cf_tbl(V::table(t.c0_cf)),
+#if defined(__aarch64__)
+          e0_ff_tbl{{ vld1q_u8(t.e0_ff), vld1q_u8(t.e0_ff + 16) }},
+#else
+          df_ee_tbl(V::table(t.df_ee)),
+          ef_fe_tbl(V::table(t.ef_fe)),
+#endif
+          prev_input(V::zero()), prev_first_len(V::zero()) {}
+
+    /* Validate next vector, return non-zero lanes for illegal bytes */
+    inline vec check(vec input) {
+        high_nibbles = V::high_nibbles(input);
+
+        /* 0 for 00~BF, 1 for C0~DF, 2 for E0~EF, 3 for F0~FF */
+        first_len = V::lookup(first_len_tbl, high_nibbles);
+
+        /* First Byte: 8 for C0~FF */
+        vec range = V::lookup(first_range_tbl, high_nibbles);
+
+        /* Second, Third, Fourth Byte: first_len shifted by 1, 2, 3 bytes,
+         * minus 0, 1, 2 (saturated) */
+        range = V::or_(range, V::template push<1>(prev_first_len, first_len));
+        range = V::or_(range, V::subs(
+                    V::template push<2>(prev_first_len, first_len), V::dup(1)));
+        range = V::or_(range, V::subs(
+                    V::template push<3>(prev_first_len, first_len), V::dup(2)));
+
+        /*
+         * Now we have below range indices
+         * - 8 for C0~FF
+         * - 3 for 1st byte after F0~FF
+         * - 2 for 1st byte after E0~EF or 2nd byte after F0~FF
+         * - 1 for 1st byte after C0~DF or 2nd byte after E0~EF or
+         *     3rd byte after F0~FF
+         * - 0 for others
+         * Overlapping First Bytes give 9~15, e.g., F1 80 C2 90 -> 8 3 10 2
+         */
+
+        /* Adjust Second Byte range for special First Bytes */
+        const vec shift1 = V::template push<1>(prev_input, input);
+        range = V::add(range, adjust(shift1));
+
+        const vec minv = V::lookup(range_min_tbl, range);
+        const vec maxv = V::lookup(range_max_tbl, range);
+
+        prev_input = input;
+        prev_first_len = first_len;
+
+        /* Non-zero if input < minv or input > maxv */
+        return V::or_(V::subs(minv, input), V::subs(input, maxv));
+    }
+
+    /* Bytes to look back from end of last vector to previous First Byte */
+    inline int lookahead() const {
+        const int32_t token4 = V::last4(prev_input);
+        const int8_t *token = (const int8_t *)&token4;
+
+        if (token[3] > (int8_t)0xBF)
+            return 1;
+        else if (token[2] > (int8_t)0xBF)
+            return 2;
+        else if (token[1] > (int8_t)0xBF)
+            return 3;
+        return 0;
+    }
+
+    /* Intermediate values of last vector, for fused kernels */
+    vec high_nibbles, first_len;
+
+private:
+    inline vec adjust(vec shift1) const {
+        vec adj;
+
+#if defined(__aarch64__)
+        /* tbl returns 0 for out of range indices */
+        adj = vqtbl2q_u8(e0_ff_tbl, V::sub(shift1, V::dup(0xE0)));
+        if (C0)
+            adj = V::add(adj, V::lookup(c0_cf_tbl,
+                                        V::sub(shift1, V::dup(0xC0))));
+#else
+        /*
+         * pshufb returns 0 for indices with 7-th bit set, else uses low
+         * 4 bits. Only DF~EE index df_ee, only EF~FE index ef_fe.
+         * shift1:  | EF  F0 ... FE | FF  00  ... ...  DE | DF  E0 ... EE |
+         * pos:     | 0   1      15 | 16  17           239| 240 241    255|
+         * pos-240: | 0   0      0  | 0   0            0  | 0   1      15 |
+         * pos+112: | 112 113    127|       >= 128        |     >= 128    |
+         */
+        const vec pos = V::sub(shift1, V::dup(0xEF));
+        adj = V::lookup(df_ee_tbl, V::subs(pos, V::dup(240)));
+        adj = V::add(adj, V::lookup(ef_fe_tbl, V::adds(pos, V::dup(112))));
+        if (C0) {
+            /* C0~CF -> 0x70~0x7F, others have 7-th bit set */
+            const vec pos_c0 = V::sub(shift1, V::dup(0xC0));
+            adj = V::add(adj, V::lookup(c0_cf_tbl,
+                                        V::adds(pos_c0, V::dup(0x70))));
+        }
+#endif
+
+        return adj;
+    }
+
+    const vec first_len_tbl, first_range_tbl, range_min_tbl, range_max_tbl;
+    const vec c0_cf_tbl;
+#if defined(__aarch64__)
+    const uint8x16x2_t e0_ff_tbl;
+#else
+    const vec df_ee_tbl, ef_fe_tbl;
+#endif
+
+public:
+    vec prev_input, prev_first_len;
+};
+
+/*
+ * Load modes of range_validate()
+ * - RANGE_NT: large buffer mode, for buffers much bigger than LLC and read
+ *   once. Prefetches NT_PREFETCH bytes ahead with non-temporal hint, one
+ *   cache line at a time, so data goes to L1 and does not evict the outer
+ *   cache lines of other workloads.
+ */
+enum { RANGE_DEFAULT, RANGE_NT };
+
+#ifndef NT_PREFETCH
+#define NT_PREFETCH     2048
+#endif
+#define RANGE_LINE      64
+
+template <class V, int U, bool C0 = false, int MODE = RANGE_DEFAULT>
+static inline int range_validate(const unsigned char *data, int len,
+                                 const RangeTables &t = range_utf8);
+
+/* Check remaining bytes with narrower vectors, SWAR method at last */
+template <class V, bool C0>
+struct RangeTail {
+    static inline int validate(const unsigned char *data, int len,
+                               const RangeTables &t) {
+        return utf8_swar(data, len) ? -1 : 0;
+    }
+};
+
+#ifdef __AVX2__
+template <bool C0>
+struct RangeTail<Avx2, C0> {
+    static inline int validate(const unsigned char *data, int len,
+                               const RangeTables &t) {
+        return range_validate<Sse, 1, C0>(data, len, t);
+    }
+};
+#endif
+
+#ifdef __AVX512BW__
+template <bool C0>
+struct RangeTail<Avx512, C0> {
+    static inline int validate(const unsigned char *data, int len,
+                               const RangeTables &t) {
+        return range_validate<Avx2, 1, C0>(data, len, t);
+    }
+};
+#endif
+
+/* One prefetch per cache line, iterations may be shorter than a line */
+template <class V, int U>
+static inline void range_prefetch(const unsigned char *data)
+{
+    const unsigned char *p = data + NT_PREFETCH;
+
+    if (V::size * U >= RANGE_LINE) {
+        for (int i = 0; i < V::size * U; i += RANGE_LINE)
+            V::prefetch_nta(p + i);
+    } else if (((uintptr_t)p & (RANGE_LINE - 1)) < V::size * U) {
+        V::prefetch_nta(p);
+    }
+}
+
+/* Return 0 on success, -1 on error */
+template <class V, int U, bool C0, int MODE>
+static inline int range_validate(const unsigned char *data, int len,
+                                 const RangeTables &t)
+{
+    typedef typename V::vec vec;
+
+    if (len >= V::size) {
+        Range<V, C0> range(t);
+        vec error[U];
+
+        for (int u = 0; u < U; ++u)
+            error[u] = V::zero();
+
+        while (len >= V::size * U) {
+            if (MODE == RANGE_NT)
+                range_prefetch<V, U>(data);
+            for (int u = 0; u < U; ++u)
+                error[u] = V::or_(error[u],
+                                  range.check(V::load(data + V::size * u)));
+            data += V::size * U;
+            len -= V::size * U;
+        }
+
+        /* Remaining vectors of unrolled loop */
+        while (U > 1 && len >= V::size) {
+            error[0] = V::or_(error[0], range.check(V::load(data)));
+            data += V::size;
+            len -= V::size;
+        }
+
+        for (int u = 1; u < U; ++u)
+            error[0] = V::or_(error[0], error[u]);
+        if (V::any(error[0]))
+            return -1;
+
+        const int lookahead = range.lookahead();
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    return RangeTail<V, C0>::validate(data, len, t);
+}
+
+/* 1 for bytes other than 80~BF, indexed by high nibble */
+static const uint8_t range_lead_tbl[16] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1,
+};
+
+/*
+ * Validate and count chars in one pass
+ * Chars are bytes other than 80~BF, counted from high nibbles computed by
+ * Range::check() into per lane byte counters, summed every 255 vectors.
+ * Return 0 on success, -1 on error, count of chars saved to *count
+ */
+template <class V>
+static inline int range_validate_count(const unsigned char *data, int len,
+                                       size_t *count)
+{
+    typedef typename V::vec vec;
+    size_t n = 0;
+
+    if (len >= V::size) {
+        Range<V> range(range_utf8);
+        const vec lead_tbl = V::table(range_lead_tbl);
+        vec error = V::zero();
+
+        while (len >= V::size) {
+            vec counter = V::zero();
+
+            for (int i = 0; i < 255 && len >= V::size; ++i) {
+                error = V::or_(error, range.check(V::load(data)));
+                counter = V::add(counter,
+                                 V::lookup(lead_tbl, range.high_nibbles));
+                data += V::size;
+                len -= V::size;
+            }
+            n += V::sum(counter);
+        }
+
+        if (V::any(error))
+            return -1;
+
+        /* First Byte looked back is counted again in the tail */
+        const int lookahead = range.lookahead();
+        if (lookahead)
+            --n;
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    size_t tail;
+    if (utf8_naive_count(data, len, &tail))
+        return -1;
+
+    *count = n + tail;
+    return 0;
+}
+
+/* Position of n-th (0 based) set bit of m */
+static inline int range_select_bit(uint64_t m, int n)
+{
+#ifdef __BMI2__
+    return __builtin_ctzll(_pdep_u64(1ULL << n, m));
+#else
+    while (n--)
+        m &= m - 1;
+    return __builtin_ctzll(m);
+#endif
+}
+
+/* Bit mask of bytes other than 80~BF */
+template <class V>
+static inline uint64_t range_lead_bits(typename V::vec lead_tbl,
+                                       typename V::vec high_nibbles)
+{
+    return V::bits(V::sub(V::zero(), V::lookup(lead_tbl, high_nibbles)));
+}
+
+/*
+ * Validate and build sparse char index in one pass (see utf8range.h)
+ * Chars of each vector are counted by popcount of lead byte mask, the
+ * indexed char is located by selecting its bit. As stride is not less than
+ * vector size, at most one index entry is recorded per vector.
+ * Return 0 on success, -1 on error
+ */
+template <class V>
+static inline int range_validate_index(const unsigned char *data, int len,
+                                       int *index, size_t *count)
+{
+    typedef typename V::vec vec;
+    const unsigned char *start = data;
+    size_t n = 0, next = 0;
+
+    if (len >= V::size) {
+        Range<V> range(range_utf8);
+        const vec lead_tbl = V::table(range_lead_tbl);
+        vec error = V::zero();
+
+        while (len >= V::size) {
+            error = V::or_(error, range.check(V::load(data)));
+            const uint64_t lead =
+                range_lead_bits<V>(lead_tbl, range.high_nibbles);
+            const int c = __builtin_popcountll(lead);
+
+            if (n + c > next) {
+                index[next / UTF8_INDEX_STRIDE] =
+                    data - start + range_select_bit(lead, next - n);
+                next += UTF8_INDEX_STRIDE;
+            }
+            n += c;
+            data += V::size;
+            len -= V::size;
+        }
+
+        if (V::any(error))
+            return -1;
+
+        /*
+         * First Byte looked back is counted again in the tail, it's already
+         * indexed if it's a multiple of stride, next is still correct
+         */
+        const int lookahead = range.lookahead();
+        if (lookahead)
+            --n;
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    if (utf8_swar(data, len))
+        return -1;
+
+    for (int i = 0; i < len; ++i) {
+        if ((signed char)data[i] > (signed char)0xBF) {
+            if (n == next) {
+                index[n / UTF8_INDEX_STRIDE] = data + i - start;
+                next += UTF8_INDEX_STRIDE;
+            }
+            ++n;
+        }
+    }
+
+    *count = n;
+    return 0;
+}
+
+/*
+ * Byte offset of k-th char (0 based) of well-formed string
+ * Return len if there are exactly k chars, -1 if less
+ */
+template <class V>
+static inline int range_skip_chars(const unsigned char *data, int len,
+                                   size_t k)
+{
+    const typename V::vec lead_tbl = V::table(range_lead_tbl);
+    int pos = 0;
+
+    for (; pos + V::size <= len; pos += V::size) {
+        const uint64_t lead = range_lead_bits<V>(lead_tbl,
+                V::high_nibbles(V::load(data + pos)));
+        const size_t c = __builtin_popcountll(lead);
+
+        if (k < c)
+            return pos + range_select_bit(lead, k);
+        k -= c;
+    }
+
+    for (; pos < len; ++pos) {
+        if ((signed char)data[pos] > (signed char)0xBF) {
+            if (k == 0)
+                return pos;
+            --k;
+        }
+    }
+
+    return k ? -1 : len;
+}
+
+/* Byte offset of k-th char from index built by range_validate_index() */
+template <class V>
+static inline int range_index_offset(const unsigned char *data, int len,
+                                     const int *index, size_t count, size_t k)
+{
+    if (k >= count)
+        return k == count ? len : -1;
+
+    const int base = index[k / UTF8_INDEX_STRIDE];
+    return base + range_skip_chars<V>(data + base, len - base,
+                                      k % UTF8_INDEX_STRIDE);
+}
+
+/* Bytes to escape in JSON string: '"', '\\', 00~1F */
+template <class V>
+static inline typename V::vec range_json_escape(typename V::vec input)
+{
+    const typename V::vec quote = V::or_(V::eq(input, V::dup('"')),
+                                         V::eq(input, V::dup('\\')));
+    return V::or_(quote, V::eq(V::subs(input, V::dup(0x1F)), V::zero()));
+}
+
+/*
+ * Validate and find JSON escapes in one pass (see utf8range.h)
+ * Escape bits of vectors are gathered to 64 bits mask words, a word is
+ * stored and counted once it's complete.
+ * Return 0 on success, -1 on error
+ */
+template <class V>
+static inline int range_validate_json(const unsigned char *data, int len,
+                                      uint64_t *mask, size_t *escapes)
+{
+    typedef typename V::vec vec;
+    uint64_t word = 0;
+    size_t n = 0;
+    int pos = 0, lookahead = 0;
+
+    if (len >= V::size) {
+        Range<V> range(range_utf8);
+        vec error = V::zero();
+
+        for (; pos + V::size <= len; pos += V::size) {
+            const vec input = V::load(data + pos);
+
+            error = V::or_(error, range.check(input));
+            word |= V::bits(range_json_escape<V>(input)) << (pos % 64);
+            if ((pos + V::size) % 64 == 0) {
+                mask[pos / 64] = word;
+                n += __builtin_popcountll(word);
+                word = 0;
+            }
+        }
+
+        if (V::any(error))
+            return -1;
+
+        /* Looked back bytes are First Bytes, never escaped */
+        lookahead = range.lookahead();
+    }
+
+    if (utf8_swar(data + pos - lookahead, len - pos + lookahead))
+        return -1;
+
+    for (; pos < len; ++pos) {
+        const unsigned char b = data[pos];
+
+        if (b < 0x20 || b == '"' || b == '\\')
+            word |= 1ULL << (pos % 64);
+        if (pos % 64 == 63) {
+            mask[pos / 64] = word;
+            n += __builtin_popcountll(word);
+            word = 0;
+        }
+    }
+    if (len % 64) {
+        mask[len / 64] = word;
+        n += __builtin_popcountll(word);
+    }
+
+    *escapes = n;
+    return 0;
+}
+
+/*
+ * Split lines by delimiter set and validate each line (see utf8range.h)
+ * Delimiters are matched by two nibble lookups, delimiter j sets bit j of
+ * entries of its low and high nibbles, a byte is a delimiter if both
+ * lookups have a common bit. The whole string is validated as one stream,
+ * errors are always flagged within the line, or at its ascii delimiter, so
+ * lines overlapping a vector with errors are marked (-1) and validated
+ * again alone with SWAR method to find the error index.
+ * Return count of lines
+ */
+template <class V>
+static inline int range_validate_lines(const unsigned char *data, int len,
+                                       const char *delims, int *ends,
+                                       int *errors, int max_lines)
+{
+    typedef typename V::vec vec;
+    const uint64_t lanes = V::size == 64 ? ~0ULL : (1ULL << V::size) - 1;
+    uint8_t lo[16] = { 0 }, hi[16] = { 0 };
+    int n = 0, pos = 0, lookahead = 0, first;
+    bool dirty = false;     /* Current line is dirty */
+
+    for (int j = 0; j < 8 && delims[j]; ++j) {
+        lo[delims[j] & 0x0F] |= 1 << j;
+        hi[(delims[j] >> 4) & 0x07] |= 1 << j;
+    }
+
+    if (max_lines <= 0)
+        return 0;
+
+    if (len >= V::size) {
+        Range<V> range(range_utf8);
+        const vec lo_tbl = V::table(lo), hi_tbl = V::table(hi);
+
+        for (; pos + V::size <= len; pos += V::size) {
+            const vec input = V::load(data + pos);
+            const vec error = range.check(input);
+            const vec match = V::and_(
+                    V::lookup(lo_tbl, V::and_(input, V::dup(0x0F))),
+                    V::lookup(hi_tbl, range.high_nibbles));
+            uint64_t delim = ~V::bits(V::eq(match, V::zero())) & lanes;
+
+            first = n;
+            for (; delim && n < max_lines; delim &= delim - 1) {
+                ends[n] = pos + __builtin_ctzll(delim);
+                errors[n++] = dirty ? -1 : 0;
+                dirty = false;
+            }
+            if (V::any(error)) {
+                for (int i = first; i < n; ++i)
+                    errors[i] = -1;
+                dirty = true;
+            }
+            if (n == max_lines)
+                goto fix;
+        }
+
+        lookahead = range.lookahead();
+    }
+
+    {
+        /* Tail and looked back First Bytes, never delimiters */
+        const bool error = utf8_swar(data + pos - lookahead,
+                                      len - pos + lookahead) != 0;
+
+        first = n;
+        for (; pos < len && n < max_lines; ++pos) {
+            const unsigned char b = data[pos];
+
+            if (lo[b & 0x0F] & hi[b >> 4 & 0x0F]) {
+                ends[n] = pos;
+                errors[n++] = dirty ? -1 : 0;
+                dirty = false;
+            }
+        }
+        if (error) {
+            for (int i = first; i < n; ++i)
+                errors[i] = -1;
+            dirty = true;
+        }
+
+        /* Last line without delimiter */
+        if (pos == len && n < max_lines && (n ? ends[n-1] + 1 : 0) < len) {
+            ends[n] = len;
+            errors[n++] = dirty ? -1 : 0;
+        }
+    }
+
+fix:
+    for (int i = 0; i < n; ++i) {
+        if (errors[i] < 0) {
+            const int start = i ? ends[i-1] + 1 : 0;
+            errors[i] = utf8_swar(data + start, ends[i] - start);
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Lanes [0, 64) of the table are 0x00, [64, 128) are 0xFF, [128, 192) 0x00
+ * - load at 64 - n: clear first n lanes
+ * - load at 128 - n: keep first n lanes
+ */
+static const uint8_t range_cstr_mask[192] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/*
+ * Validate NUL terminated string and find its length in one pass
+ * Only aligned vectors are loaded, which never cross a page boundary, so
+ * reading beyond NUL cannot fault. But memory checkers may complain.
+ * Bytes before string start and after NUL are replaced with 0 (ascii).
+ * Return 0 on success, -1 on error, string length saved to *len
+ */
+template <class V, bool C0 = false>
+static inline int range_validate_cstr(const char *str, size_t *len,
+                                      const RangeTables &t = range_utf8)
+{
+    typedef typename V::vec vec;
+
+    const unsigned char *start = (const unsigned char *)str;
+    const unsigned char *p =
+        (const unsigned char *)((uintptr_t)str & ~(uintptr_t)(V::size - 1));
+    const int off = start - p;
+
+    Range<V, C0> range(t);
+    vec error = V::zero();
+
+    const vec keep = V::load(range_cstr_mask + 64 - off);
+    vec input = V::and_(V::load(p), keep);
+    vec nul = V::and_(V::eq(input, V::zero()), keep);
+
+    while (!V::any(nul)) {
+        error = V::or_(error, range.check(input));
+        p += V::size;
+        input = V::load(p);
+        nul = V::eq(input, V::zero());
+    }
+
+    const int n = V::first(nul);
+    *len = p + n - start;
+
+    /* First missing byte of truncated last character is NUL itself */
+    input = V::and_(input, V::load(range_cstr_mask + 128 - n));
+    error = V::or_(error, range.check(input));
+
+    return V::any(error) ? -1 : 0;
+}
+
+/*
+ * Tables of range algorithm enforcing code point policy, see utf8range.h
+ * - NUL, CONTROL(DEL): shrink ascii range (index 0)
+ * - C1: C2 adjusts Second Byte to A0~BF (index 4) via c0_cf, requires C0
+ *   version of Range
+ * - PRIVATE: EE makes Second Byte illegal (index 15), EF restricts it to
+ *   A4~BF (new index 9), F3 to 80~AF (new index 10), F4 is not a legal First
+ *   Byte. Index 9, 10 are safe for overlapped First Bytes as max <= BF.
+ * Other policies are checked by range_policy_check().
+ */
+static inline void range_policy_tables(RangeTables *t, unsigned int policy)
+{
+    *t = range_utf8;
+
+    if (policy & UTF8_POLICY_NUL)
+        t->range_min[0] = 0x01;
+    if (policy & UTF8_POLICY_CONTROL)
+        t->range_max[0] = 0x7E;
+    if (policy & UTF8_POLICY_C1)
+        t->c0_cf[0xC2 - 0xC0] = 3;
+    if (policy & UTF8_POLICY_PRIVATE) {
+        t->range_max[8] = 0xF3;
+        t->range_min[9] = 0xA4;
+        t->range_max[9] = 0xBF;
+        t->range_min[10] = 0x80;
+        t->range_max[10] = 0xAF;
+        t->df_ee[0xEE - 0xDF] = 13;
+        t->ef_fe[0xEF - 0xEF] = 7;
+        t->ef_fe[0xF3 - 0xEF] = 7;
+        t->e0_ff[0xEE - 0xE0] = 13;
+        t->e0_ff[0xEF - 0xE0] = 7;
+        t->e0_ff[0xF3 - 0xE0] = 7;
+    }
+}
+
+/*
+ * Policies not expressible by Second Byte range, checked on vectors
+ * Return non-zero lanes for rejected bytes
+ */
+template <class V, bool CONTROL, bool NONCHAR>
+static inline typename V::vec range_policy_check(typename V::vec prev,
+                                                 typename V::vec input)
+{
+    typedef typename V::vec vec;
+    static const uint8_t ws_tbl[16] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, '\t', '\n', 0xFF, 0xFF, '\r', 0xFF, 0xFF,
+    };
+    vec error = V::zero();
+
+    /* 00~1F except TAB, LF, CR */
+    if (CONTROL) {
+        const vec ctrl = V::eq(V::subs(input, V::dup(0x1F)), V::zero());
+        const vec ws = V::eq(V::lookup(V::table(ws_tbl), input), input);
+        error = V::andnot(ws, ctrl);
+    }
+
+    /* EF B7 90~AF, EF BF BE~BF, F0~F4 xF BF BE~BF */
+    if (NONCHAR) {
+        const vec prev1 = V::template push<1>(prev, input);
+        const vec prev2 = V::template push<2>(prev, input);
+        const vec ef = V::eq(prev2, V::dup(0xEF));
+
+        /* Rare in real text, filter with last two bytes first */
+        const vec bf_bx = V::and_(V::eq(prev1, V::dup(0xBF)),
+                V::eq(V::or_(input, V::dup(1)), V::dup(0xBF)));
+        const vec ef_b7 = V::and_(ef, V::eq(prev1, V::dup(0xB7)));
+
+        if (V::any(V::or_(bf_bx, ef_b7))) {
+            const vec prev3 = V::template push<3>(prev, input);
+            const vec below_f0 =
+                V::eq(V::subs(prev3, V::dup(0xEF)), V::zero());
+            const vec low_f =
+                V::eq(V::or_(prev2, V::dup(0xF0)), V::dup(0xFF));
+            const vec nonchar = V::and_(bf_bx,
+                    V::or_(ef, V::andnot(below_f0, low_f)));
+
+            const vec fdd0 = V::and_(ef_b7, V::eq(V::subs(
+                    V::sub(input, V::dup(0x90)), V::dup(0x1F)), V::zero()));
+
+            error = V::or_(error, V::or_(nonchar, fdd0));
+        }
+    }
+
+    return error;
+}
+
+/* Return 0 on success, -1 on error */
+template <class V, bool C0, bool CONTROL, bool NONCHAR>
+static inline int range_validate_policy(const unsigned char *data, int len,
+                                        unsigned int policy)
+{
+    typedef typename V::vec vec;
+
+    if (len >= V::size) {
+        RangeTables t;
+        range_policy_tables(&t, policy);
+
+        Range<V, C0> range(t);
+        vec error = V::zero();
+
+        while (len >= V::size) {
+            const vec input = V::load(data);
+            const vec prev = range.prev_input;
+
+            error = V::or_(error, range.check(input));
+            if (CONTROL || NONCHAR)
+                error = V::or_(error, range_policy_check<V, CONTROL, NONCHAR>(
+                            prev, input));
+            data += V::size;
+            len -= V::size;
+        }
+
+        if (V::any(error))
+            return -1;
+
+        const int lookahead = range.lookahead();
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    return utf8_policy_naive(data, len, policy) ? -1 : 0;
+}
+
+/*
+ * Instantiate kernel per policies requiring extra operations
+ * - C1: C0 version of Range
+ * - CONTROL, NONCHAR: range_policy_check()
+ */
+template <class V>
+static inline int range_validate_policy(const unsigned char *data, int len,
+                                        unsigned int policy)
+{
+    const unsigned int C1 = UTF8_POLICY_C1, CTRL = UTF8_POLICY_CONTROL,
+                       NC = UTF8_POLICY_NONCHAR;
+
+    switch (policy & (C1 | CTRL | NC)) {
+    case 0:
+        return range_validate_policy<V, false, false, false>(data, len, policy);
+    case CTRL:
+        return range_validate_policy<V, false, true, false>(data, len, policy);
+    case NC:
+        return range_validate_policy<V, false, false, true>(data, len, policy);
+    case CTRL | NC:
+        return range_validate_policy<V, false, true, true>(data, len, policy);
+    case C1:
+        return range_validate_policy<V, true, false, false>(data, len, policy);
+    case C1 | CTRL:
+        return range_validate_policy<V, true, true, false>(data, len, policy);
+    case C1 | NC:
+        return range_validate_policy<V, true, false, true>(data, len, policy);
+    default:
+        return range_validate_policy<V, true, true, true>(data, len, policy);
+    }
+}
+
+/*
+ * CESU-8 and MUTF-8, see mutf8.c
+ * - CESU-8: F0~F4 are not legal First Bytes, ED takes Second Byte 80~BF
+ *   (no adjustment). Surrogate pairs are checked by SurrogatePairs.
+ * - MUTF-8: C0 is a legal First Byte, adjusted to take only 80 (index 6,
+ *   not used by F0 any more), C1 makes Second Byte illegal (index 9). 00 is
+ *   not legal. Requires C0 version of Range.
+ */
+static const RangeTables range_cesu8 = {
+    /* first_len */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 3 },
+    /* first_range */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 8, 8, 8 },
+    /* range_min */
+    { 0x00, 0x80, 0x80, 0x80, 0xA0, 0x80, 0x90, 0x80,
+      0xC2, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF },
+    /* range_max */
+    { 0x7F, 0xBF, 0xBF, 0xBF, 0xBF, 0x9F, 0xBF, 0x8F,
+      0xEF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    /* c0_cf */
+    { 0 },
+    /* df_ee: E0 -> 2 */
+    { 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* ef_fe */
+    { 0 },
+    /* e0_ff */
+    { 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static const RangeTables range_mutf8 = {
+    /* first_len */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 3 },
+    /* first_range */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 8, 8, 8 },
+    /* range_min */
+    { 0x01, 0x80, 0x80, 0x80, 0xA0, 0x80, 0x80, 0x80,
+      0xC0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF },
+    /* range_max */
+    { 0x7F, 0xBF, 0xBF, 0xBF, 0xBF, 0x9F, 0x80, 0x8F,
+      0xEF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    /* c0_cf: C0 -> 5, C1 -> 8 */
+    { 5, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* df_ee: E0 -> 2 */
+    { 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* ef_fe */
+    { 0 },
+    /* e0_ff */
+    { 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+/*
+ * Surrogate pairs in 3 bytes form, high (ED A0~AF) followed by low (ED B0~BF)
+ * Mark Second Bytes of both, a pair has high mark pushed by 3 bytes on low
+ * - PAIRED (CESU-8): every surrogate must be paired, marks must be equal
+ * - !PAIRED (WTF-8): pairs are illegal, marks must not overlap
+ */
+template <class V, bool PAIRED>
+class SurrogatePairs {
+public:
+    typedef typename V::vec vec;
+
+    SurrogatePairs() : high(V::zero()) {}
+
+    /* Return non-zero lanes for illegal surrogates */
+    inline vec check(vec prev_input, vec input) {
+        const vec ed = V::eq(V::template push<1>(prev_input, input),
+                             V::dup(0xED));
+        const vec second = V::and_(ed, V::and_(input, V::dup(0xF0)));
+        const vec prev_high = high;
+
+        high = V::eq(second, V::dup(0xA0));
+        const vec high3 = V::template push<3>(prev_high, high);
+        const vec low = V::eq(second, V::dup(0xB0));
+        return PAIRED ? V::xor_(high3, low) : V::and_(high3, low);
+    }
+
+    /* Bytes to look back for a high surrogate whose next char is unchecked */
+    inline int lookahead() const {
+        const int32_t high4 = V::last4(high);
+        const int8_t *h = (const int8_t *)&high4;
+
+        /* Last 2 bytes are covered by Range::lookahead() */
+        return h[1] ? 4 : 0;
+    }
+
+    vec high;
+};
+
+/* Return 0 on success, -1 on error */
+template <class V, bool MUTF8>
+static inline int range_validate_cesu8(const unsigned char *data, int len)
+{
+    typedef typename V::vec vec;
+
+    if (len >= V::size) {
+        Range<V, MUTF8> range(MUTF8 ? range_mutf8 : range_cesu8);
+        SurrogatePairs<V, true> pairs;
+        vec error = V::zero();
+
+        while (len >= V::size) {
+            const vec input = V::load(data);
+
+            error = V::or_(error, pairs.check(range.prev_input, input));
+            error = V::or_(error, range.check(input));
+            data += V::size;
+            len -= V::size;
+        }
+
+        if (V::any(error))
+            return -1;
+
+        int lookahead = range.lookahead();
+        if (pairs.lookahead() > lookahead)
+            lookahead = pairs.lookahead();
+        data -= lookahead;
+        len += lookahead;
+
+        /*
+         * Low surrogate starting the tail was paired with previous char by
+         * vectors, or its Second Byte is not checked. Either way, include
+         * previous 3 bytes, which fail naive check if not a high surrogate.
+         */
+        if (len >= 2 && data[0] == 0xED && (data[1] & 0xF0) == 0xB0) {
+            data -= 3;
+            len += 3;
+        }
+    }
+
+    if (MUTF8)
+        return utf8_mutf8_naive(data, len) ? -1 : 0;
+    return utf8_cesu8_naive(data, len) ? -1 : 0;
+}
+
+/*
+ * Convert valid MUTF-8 to UTF-8, return bytes of output
+ * Copy vectors until C0 80 or high surrogate, which are converted by scalar
+ * code. Output never exceeds input, so stores of a whole vector are safe
+ * given dst buffer is as long as input.
+ */
+template <class V>
+static inline size_t range_mutf8_convert(const unsigned char *src, size_t len,
+                                         unsigned char *dst)
+{
+    typedef typename V::vec vec;
+    unsigned char *const dst0 = dst;
+
+    while (len) {
+        size_t n = 0;
+
+        /* Also loads next byte of each lane */
+        while (n + V::size < len) {
+            const vec input = V::load(src + n);
+            const vec next = V::load(src + n + 1);
+            const vec special = V::or_(V::eq(input, V::dup(0xC0)),
+                    V::and_(V::eq(input, V::dup(0xED)),
+                            V::eq(V::and_(next, V::dup(0xF0)), V::dup(0xA0))));
+
+            V::store(dst + n, input);
+            /* Don't make next address depend on compare result */
+            if (V::any(special)) {
+                n += V::first(special);
+                break;
+            }
+            n += V::size;
+        }
+        /* No more vectors, copy bytes till special or end */
+        if (n + V::size >= len) {
+            while (n < len && src[n] != 0xC0 &&
+                    !(src[n] == 0xED && n + 1 < len &&
+                      (src[n+1] & 0xF0) == 0xA0)) {
+                dst[n] = src[n];
+                ++n;
+            }
+        }
+        src += n;
+        dst += n;
+        len -= n;
+        if (len == 0)
+            break;
+
+        if (src[0] == 0xC0) {
+            /* C0 80 -> 00 */
+            *dst++ = 0;
+            src += 2;
+            len -= 2;
+        } else {
+            /* ED A0~AF xx ED B0~BF xx -> F0~F4 xx xx xx */
+            const unsigned int u = 0x10000 +
+                (((src[1] & 0x0F) << 16) | ((src[2] & 0x3F) << 10) |
+                 ((src[4] & 0x0F) << 6) | (src[5] & 0x3F));
+
+            dst[0] = 0xF0 | (u >> 18);
+            dst[1] = 0x80 | ((u >> 12) & 0x3F);
+            dst[2] = 0x80 | ((u >> 6) & 0x3F);
+            dst[3] = 0x80 | (u & 0x3F);
+            dst += 4;
+            src += 6;
+            len -= 6;
+        }
+    }
+
+    return dst - dst0;
+}
+
+/* Return 0 on success, -1 on error or if output buffer may overflow */
+template <class V>
+static inline int range_mutf8_to_utf8(const unsigned char *src, size_t len,
+                                      unsigned char *dst, size_t *dst_len)
+{
+    if (*dst_len < len || range_validate_cesu8<V, true>(src, len))
+        return -1;
+
+    *dst_len = range_mutf8_convert<V>(src, len, dst);
+    return 0;
+}
+
+/*
+ * WTF-8, see wtf8.c
+ * Same as UTF-8 except ED takes Second Byte 80~BF (no adjustment), surrogate
+ * pairs in 3 bytes form are rejected by SurrogatePairs.
+ */
+static const RangeTables range_wtf8 = {
+    /* first_len */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 3 },
+    /* first_range */
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 8, 8, 8 },
+    /* range_min */
+    { 0x00, 0x80, 0x80, 0x80, 0xA0, 0x80, 0x90, 0x80,
+      0xC2, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF },
+    /* range_max */
+    { 0x7F, 0xBF, 0xBF, 0xBF, 0xBF, 0x9F, 0xBF, 0x8F,
+      0xF4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    /* c0_cf */
+    { 0 },
+    /* df_ee: E0 -> 2 */
+    { 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* ef_fe: F0 -> 3, F4 -> 4 */
+    { 0, 3, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    /* e0_ff */
+    { 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      3, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+/* Return 0 on success, -1 on error */
+template <class V>
+static inline int range_validate_wtf8(const unsigned char *data, int len)
+{
+    typedef typename V::vec vec;
+
+    if (len >= V::size) {
+        Range<V> range(range_wtf8);
+        SurrogatePairs<V, false> pairs;
+        vec error = V::zero();
+
+        while (len >= V::size) {
+            const vec input = V::load(data);
+
+            error = V::or_(error, pairs.check(range.prev_input, input));
+            error = V::or_(error, range.check(input));
+            data += V::size;
+            len -= V::size;
+        }
+
+        if (V::any(error))
+            return -1;
+
+        /*
+         * Low surrogate starting the tail was checked against previous char
+         * by vectors, unless its Second Byte is beyond last vector. Then the
+         * high surrogate before it, if any, is looked back by SurrogatePairs.
+         */
+        int lookahead = range.lookahead();
+        if (pairs.lookahead() > lookahead)
+            lookahead = pairs.lookahead();
+        data -= lookahead;
+        len += lookahead;
+    }
+
+    return utf8_wtf8_naive(data, len) ? -1 : 0;
+}
+
+#endif
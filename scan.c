@@ -0,0 +1,401 @@
+/*
+ * Parallel recursive directory validation, see scan.h
+ *
+ * Work items are directories. A worker pushes subdirectories it finds on
+ * top of its own deque and pops from the top, depth first. Idle workers
+ * steal from the bottom of other deques, i.e., the oldest and usually the
+ * biggest subtrees. Files are opened relative to their directory and read
+ * into the worker's buffer, nothing is allocated per file.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scan.h"
+#include "utf8range.h"
+
+#define SCAN_BUF        (256*1024)      /* Bytes per read when streaming */
+
+struct deque {
+    pthread_mutex_t lock;
+    char **dirs;
+    int head, tail, cap;        /* dirs[head, tail) are queued */
+};
+
+struct worker {
+    struct scan *scan;
+    int id;
+    pthread_t thread;
+    struct deque q;
+    unsigned char *buf;
+    char *path;                 /* Path of reported file */
+    size_t path_cap;
+    struct scan_stats stats;
+};
+
+struct scan {
+    long long mmap_max;
+    scan_report_fn report;
+    void *arg;
+    struct worker *workers;
+    int nworkers;
+    long pending;               /* Directories queued or being read */
+    int nomem;
+};
+
+static int push(struct worker *w, char *dir)
+{
+    struct deque *q = &w->q;
+    int ret = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->cap) {
+        if (q->head) {
+            memmove(q->dirs, q->dirs + q->head,
+                    (q->tail - q->head) * sizeof(char *));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            const int cap = q->cap ? q->cap * 2 : 64;
+            char **dirs = realloc(q->dirs, cap * sizeof(char *));
+
+            if (dirs) {
+                q->dirs = dirs;
+                q->cap = cap;
+            } else {
+                ret = -1;
+            }
+        }
+    }
+    if (ret == 0) {
+        __atomic_add_fetch(&w->scan->pending, 1, __ATOMIC_RELAXED);
+        q->dirs[q->tail++] = dir;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ret;
+}
+
+/* Owner pops newest, thieves take oldest */
+static char *pop(struct deque *q, int steal)
+{
+    char *dir = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head != q->tail) {
+        dir = steal ? q->dirs[q->head++] : q->dirs[--q->tail];
+        if (q->head == q->tail)
+            q->head = q->tail = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return dir;
+}
+
+/* "dir/name" in reused buffer, name alone if dir is NULL */
+static const char *join(struct worker *w, const char *dir, const char *name)
+{
+    const size_t dlen = dir ? strlen(dir) : 0;
+    const size_t size = dlen + strlen(name) + 2;
+
+    if (size > w->path_cap) {
+        char *path = realloc(w->path, size);
+
+        if (path == NULL)
+            return name;
+        w->path = path;
+        w->path_cap = size;
+    }
+
+    char *p = w->path;
+    if (dlen) {
+        memcpy(p, dir, dlen);
+        p += dlen;
+        if (p[-1] != '/')
+            *p++ = '/';
+    }
+    strcpy(p, name);
+
+    return w->path;
+}
+
+static char *dup_join(const char *dir, const char *name)
+{
+    const size_t dlen = strlen(dir);
+    const int slash = dlen && dir[dlen-1] != '/';
+    char *path = malloc(dlen + slash + strlen(name) + 1);
+
+    if (path) {
+        memcpy(path, dir, dlen);
+        path[dlen] = '/';
+        strcpy(path + dlen + slash, name);
+    }
+    return path;
+}
+
+/* Advance line and column over valid UTF-8 */
+static void advance(const unsigned char *p, int n,
+                    long long *line, long long *column)
+{
+    const unsigned char *nl;
+    size_t chars;
+
+    while (n && (nl = memchr(p, '\n', n))) {
+        ++*line;
+        *column = 1;
+        n -= nl + 1 - p;
+        p = nl + 1;
+    }
+    utf8_validate_count(p, n, &chars);
+    *column += chars;
+}
+
+/* Line and column of err, re-reading streamed file from start */
+static void locate(struct worker *w, int fd, const unsigned char *data,
+                   long long err, long long *line, long long *column)
+{
+    *line = *column = 1;
+    if (data) {
+        advance(data, err - 1, line, column);
+        return;
+    }
+
+    for (long long pos = 0; pos < err - 1; ) {
+        const long long left = err - 1 - pos;
+        ssize_t n = pread(fd, w->buf, left < SCAN_BUF ?
+                          left : SCAN_BUF, pos);
+
+        if (n <= 0)
+            break;
+
+        /* A char cut by the buffer end is read again with next buffer */
+        for (int i = 1; i <= 3 && i < n; ++i) {
+            const unsigned char b = w->buf[n - i];
+
+            if ((b & 0xC0) != 0x80) {
+                if (b >= 0xC0 && (b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : 2) > i)
+                    n -= i;
+                break;
+            }
+        }
+        advance(w->buf, n, line, column);
+        pos += n;
+    }
+}
+
+static long long scan_stream(struct worker *w, int fd)
+{
+    struct utf8_stream stream;
+    ssize_t n;
+    long long err = 0;
+
+    utf8_stream_init(&stream);
+    while ((n = read(fd, w->buf, SCAN_BUF)) > 0) {
+        w->stats.bytes += n;
+        err = utf8_stream_update(&stream, w->buf, n);
+        if (err)
+            break;
+    }
+    if (n < 0)
+        return -errno;
+
+    return utf8_stream_finish(&stream);
+}
+
+static void scan_file(struct worker *w, int dfd, const char *dir,
+                      const char *name)
+{
+    struct stat st;
+    long long err, line = 0, column = 0;
+    const unsigned char *data = NULL;
+    const int fd = openat(dfd, name,
+                          O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NOFOLLOW);
+
+    if (fd < 0 || fstat(fd, &st)) {
+        err = -errno;
+    } else if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return;
+    } else if (st.st_size == 0) {
+        err = 0;
+    } else if (st.st_size <= w->scan->mmap_max &&
+               (data = mmap(NULL, st.st_size, PROT_READ,
+                            MAP_PRIVATE | MAP_POPULATE, fd, 0)) !=
+                   MAP_FAILED) {
+        w->stats.bytes += st.st_size;
+        err = utf8_validate(data, st.st_size);
+    } else {
+        data = NULL;
+        err = scan_stream(w, fd);
+    }
+
+    if (err > 0)
+        locate(w, fd, data, err, &line, &column);
+    if (data)
+        munmap((void *)data, st.st_size);
+    if (fd >= 0)
+        close(fd);
+
+    ++w->stats.files;
+    if (err) {
+        if (err > 0)
+            ++w->stats.invalid;
+        else
+            ++w->stats.failed;
+        w->scan->report(join(w, dir, name), err, line, column,
+                        w->scan->arg);
+    }
+}
+
+static void scan_dir(struct worker *w, const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+
+    if (d == NULL) {
+        ++w->stats.failed;
+        w->scan->report(dir, -errno, 0, 0, w->scan->arg);
+        return;
+    }
+
+    ++w->stats.dirs;
+    while ((e = readdir(d))) {
+        const char *name = e->d_name;
+        int type = e->d_type;
+        struct stat st;
+
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        if (type == DT_UNKNOWN) {
+            if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW))
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR :
+                   S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_REG) {
+            scan_file(w, dirfd(d), dir, name);
+        } else if (type == DT_DIR) {
+            char *sub = dup_join(dir, name);
+
+            if (sub == NULL || push(w, sub)) {
+                free(sub);
+                __atomic_store_n(&w->scan->nomem, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    closedir(d);
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct scan *s = w->scan;
+
+    for (;;) {
+        char *dir = pop(&w->q, 0);
+
+        for (int k = 1; dir == NULL && k < s->nworkers; ++k)
+            dir = pop(&s->workers[(w->id + k) % s->nworkers].q, 1);
+
+        if (dir == NULL) {
+            if (__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) == 0)
+                break;
+            sched_yield();
+            continue;
+        }
+
+        scan_dir(w, dir);
+        free(dir);
+        /* Subdirectories were queued before, pending never drops early */
+        __atomic_sub_fetch(&s->pending, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+int scan_tree(const char *root, const struct scan_opts *opts,
+              scan_report_fn report, void *arg, struct scan_stats *stats)
+{
+    struct scan s = {
+        .mmap_max = opts && opts->mmap_max ? opts->mmap_max : SCAN_MMAP_MAX,
+        .report = report,
+        .arg = arg,
+        .nworkers = opts && opts->threads > 0 ?
+                    opts->threads : sysconf(_SC_NPROCESSORS_ONLN),
+    };
+    struct stat st;
+    int started, ret = 0;
+
+    /* utf8_validate() takes int length */
+    if (s.mmap_max > INT_MAX)
+        s.mmap_max = INT_MAX;
+    if (s.nworkers < 1)
+        s.nworkers = 1;
+    memset(stats, 0, sizeof(*stats));
+
+    s.workers = calloc(s.nworkers, sizeof(struct worker));
+    if (s.workers == NULL)
+        return -1;
+    for (int i = 0; i < s.nworkers; ++i) {
+        struct worker *w = &s.workers[i];
+
+        w->scan = &s;
+        w->id = i;
+        pthread_mutex_init(&w->q.lock, NULL);
+        w->buf = malloc(SCAN_BUF);
+        if (w->buf == NULL)
+            ret = -1;
+    }
+
+    if (ret) {
+        /* Nothing started */
+    } else if (stat(root, &st) == 0 && !S_ISDIR(st.st_mode)) {
+        scan_file(&s.workers[0], AT_FDCWD, NULL, root);
+    } else {
+        char *dir = strdup(root);
+
+        if (dir == NULL || push(&s.workers[0], dir)) {
+            free(dir);
+            ret = -1;
+        }
+    }
+
+    /* Calling thread is worker 0, fewer workers if threads cannot start */
+    for (started = 1; ret == 0 && started < s.nworkers; ++started) {
+        if (pthread_create(&s.workers[started].thread, NULL, worker_main,
+                           &s.workers[started]))
+            break;
+    }
+    if (ret == 0)
+        worker_main(&s.workers[0]);
+
+    for (int i = 0; i < s.nworkers; ++i) {
+        struct worker *w = &s.workers[i];
+
+        if (ret == 0 && i && i < started)
+            pthread_join(w->thread, NULL);
+        stats->files += w->stats.files;
+        stats->dirs += w->stats.dirs;
+        stats->bytes += w->stats.bytes;
+        stats->invalid += w->stats.invalid;
+        stats->failed += w->stats.failed;
+        pthread_mutex_destroy(&w->q.lock);
+        free(w->q.dirs);
+        free(w->buf);
+        free(w->path);
+    }
+    free(s.workers);
+
+    return ret || s.nomem ? -1 : 0;
+}
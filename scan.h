@@ -0,0 +1,43 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/*
+ * Parallel recursive directory validation (POSIX threads)
+ *
+ * Walks a directory tree with a pool of workers, each owning a deque of
+ * directories and stealing from others when it runs dry. Regular files are
+ * validated as their directory is read. Files up to mmap_max bytes are
+ * mapped, bigger files are streamed through a per worker buffer. Symbolic
+ * links are not followed.
+ */
+
+/* Files above this size are streamed rather than mapped */
+#define SCAN_MMAP_MAX   (64*1024*1024)
+
+struct scan_opts {
+    int threads;                /* Workers, 0 for online CPUs */
+    long long mmap_max;         /* 0 for SCAN_MMAP_MAX */
+};
+
+struct scan_stats {
+    long long files, dirs, bytes, invalid, failed;
+};
+
+/*
+ * Called for each invalid file and each file or directory that cannot be
+ * read, from worker threads, concurrently
+ * err: >0 - index(1 based) of first error byte, line and column (in chars)
+ *           of it, both 1 based
+ *      <0 - -errno, line and column are 0
+ */
+typedef void (*scan_report_fn)(const char *path, long long err,
+                               long long line, long long column, void *arg);
+
+/*
+ * Validate root, a directory or a file
+ * Return 0 on success, -1 if out of memory or no thread can be started
+ */
+int scan_tree(const char *root, const struct scan_opts *opts,
+              scan_report_fn report, void *arg, struct scan_stats *stats);
+
+#endif
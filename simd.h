@@ -0,0 +1,274 @@
+/*
+ * Thin vector traits for single source SIMD kernels (C++)
+ *
+ * Each ISA provides the same set of static inline operations on unsigned
+ * 8-bit lanes. Table lookups index a 16 bytes table repeated per 128 bits
+ * lane. Indices 0~15 are portable. Indices with 7-th bit set return 0 on
+ * all ISAs, other indices >= 16 are ISA specific (low 4 bits used on x86,
+ * return 0 on NEON).
+ *
+ * - Sse:    SSE4.1, 16 bytes
+ * - Avx2:   AVX2, 32 bytes
+ * - Avx512: AVX512BW, 64 bytes
+ * - Neon:   armv8a NEON, 16 bytes
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+
+struct Sse {
+    typedef __m128i vec;
+    enum { size = 16 };
+
+    static inline vec load(const unsigned char *p) {
+        return _mm_loadu_si128((const __m128i *)p);
+    }
+    static inline void store(unsigned char *p, vec v) {
+        _mm_storeu_si128((__m128i *)p, v);
+    }
+    /* Fetch line of p towards L1, not kept in outer caches */
+    static inline void prefetch_nta(const unsigned char *p) {
+        _mm_prefetch((const char *)p, _MM_HINT_NTA);
+    }
+    /* Load 16 bytes table */
+    static inline vec table(const void *t) {
+        return _mm_loadu_si128((const __m128i *)t);
+    }
+    static inline vec dup(uint8_t v) { return _mm_set1_epi8(v); }
+    static inline vec zero() { return _mm_setzero_si128(); }
+
+    static inline vec lookup(vec t, vec idx) {
+        return _mm_shuffle_epi8(t, idx);
+    }
+    static inline vec high_nibbles(vec v) {
+        return _mm_and_si128(_mm_srli_epi16(v, 4), dup(0x0F));
+    }
+    /* Last N bytes of prev followed by cur, i.e., (cur, prev) << N bytes */
+    template <int N> static inline vec push(vec prev, vec cur) {
+        return _mm_alignr_epi8(cur, prev, 16 - N);
+    }
+
+    static inline vec or_(vec a, vec b) { return _mm_or_si128(a, b); }
+    static inline vec and_(vec a, vec b) { return _mm_and_si128(a, b); }
+    /* ~a & b */
+    static inline vec andnot(vec a, vec b) { return _mm_andnot_si128(a, b); }
+    static inline vec xor_(vec a, vec b) { return _mm_xor_si128(a, b); }
+    static inline vec add(vec a, vec b) { return _mm_add_epi8(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm_sub_epi8(a, b); }
+    static inline vec adds(vec a, vec b) { return _mm_adds_epu8(a, b); }
+    static inline vec subs(vec a, vec b) { return _mm_subs_epu8(a, b); }
+    static inline vec eq(vec a, vec b) { return _mm_cmpeq_epi8(a, b); }
+
+    static inline bool any(vec v) { return !_mm_testz_si128(v, v); }
+    /* Index of first 0xFF lane of a compare result, size if none */
+    static inline int first(vec v) {
+        return __builtin_ctz(_mm_movemask_epi8(v) | 0x10000);
+    }
+    /* Bit i set if lane i of a compare result is 0xFF */
+    static inline uint64_t bits(vec v) {
+        return (uint32_t)_mm_movemask_epi8(v);
+    }
+    /* Last 4 bytes */
+    static inline int32_t last4(vec v) { return _mm_extract_epi32(v, 3); }
+    /* Sum of all lanes */
+    static inline uint64_t sum(vec v) {
+        const __m128i s = _mm_sad_epu8(v, zero());
+        return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+    }
+};
+
+#ifdef __AVX2__
+struct Avx2 {
+    typedef __m256i vec;
+    enum { size = 32 };
+
+    static inline vec load(const unsigned char *p) {
+        return _mm256_loadu_si256((const __m256i *)p);
+    }
+    static inline void store(unsigned char *p, vec v) {
+        _mm256_storeu_si256((__m256i *)p, v);
+    }
+    static inline void prefetch_nta(const unsigned char *p) {
+        _mm_prefetch((const char *)p, _MM_HINT_NTA);
+    }
+    static inline vec table(const void *t) {
+        return _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i *)t));
+    }
+    static inline vec dup(uint8_t v) { return _mm256_set1_epi8(v); }
+    static inline vec zero() { return _mm256_setzero_si256(); }
+
+    static inline vec lookup(vec t, vec idx) {
+        return _mm256_shuffle_epi8(t, idx);
+    }
+    static inline vec high_nibbles(vec v) {
+        return _mm256_and_si256(_mm256_srli_epi16(v, 4), dup(0x0F));
+    }
+    template <int N> static inline vec push(vec prev, vec cur) {
+        return _mm256_alignr_epi8(
+                cur, _mm256_permute2x128_si256(prev, cur, 0x21), 16 - N);
+    }
+
+    static inline vec or_(vec a, vec b) { return _mm256_or_si256(a, b); }
+    static inline vec and_(vec a, vec b) { return _mm256_and_si256(a, b); }
+    static inline vec andnot(vec a, vec b) {
+        return _mm256_andnot_si256(a, b);
+    }
+    static inline vec xor_(vec a, vec b) { return _mm256_xor_si256(a, b); }
+    static inline vec add(vec a, vec b) { return _mm256_add_epi8(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm256_sub_epi8(a, b); }
+    static inline vec adds(vec a, vec b) { return _mm256_adds_epu8(a, b); }
+    static inline vec subs(vec a, vec b) { return _mm256_subs_epu8(a, b); }
+    static inline vec eq(vec a, vec b) { return _mm256_cmpeq_epi8(a, b); }
+
+    static inline bool any(vec v) { return !_mm256_testz_si256(v, v); }
+    static inline int first(vec v) {
+        return __builtin_ctzll((uint32_t)_mm256_movemask_epi8(v) |
+                               (1ULL << 32));
+    }
+    static inline uint64_t bits(vec v) {
+        return (uint32_t)_mm256_movemask_epi8(v);
+    }
+    static inline int32_t last4(vec v) { return _mm256_extract_epi32(v, 7); }
+    static inline uint64_t sum(vec v) {
+        const __m256i s = _mm256_sad_epu8(v, zero());
+        return _mm256_extract_epi64(s, 0) + _mm256_extract_epi64(s, 1) +
+               _mm256_extract_epi64(s, 2) + _mm256_extract_epi64(s, 3);
+    }
+};
+#endif
+
+#ifdef __AVX512BW__
+struct Avx512 {
+    typedef __m512i vec;
+    enum { size = 64 };
+
+    static inline vec load(const unsigned char *p) {
+        return _mm512_loadu_si512((const void *)p);
+    }
+    static inline void store(unsigned char *p, vec v) {
+        _mm512_storeu_si512((void *)p, v);
+    }
+    static inline void prefetch_nta(const unsigned char *p) {
+        _mm_prefetch((const char *)p, _MM_HINT_NTA);
+    }
+    /* maskz versions avoid gcc false uninitialized warnings */
+    static inline vec table(const void *t) {
+        return _mm512_maskz_broadcast_i32x4(
+                0xFFFF, _mm_loadu_si128((const __m128i *)t));
+    }
+    static inline vec dup(uint8_t v) { return _mm512_set1_epi8(v); }
+    static inline vec zero() { return _mm512_setzero_si512(); }
+
+    static inline vec lookup(vec t, vec idx) {
+        return _mm512_shuffle_epi8(t, idx);
+    }
+    static inline vec high_nibbles(vec v) {
+        return _mm512_and_si512(_mm512_srli_epi16(v, 4), dup(0x0F));
+    }
+    /* Bring last 128 bits of prev before first three 128 bits of cur */
+    template <int N> static inline vec push(vec prev, vec cur) {
+        return _mm512_alignr_epi8(
+                cur, _mm512_maskz_alignr_epi64(0xFF, cur, prev, 6), 16 - N);
+    }
+
+    static inline vec or_(vec a, vec b) { return _mm512_or_si512(a, b); }
+    static inline vec and_(vec a, vec b) { return _mm512_and_si512(a, b); }
+    static inline vec andnot(vec a, vec b) {
+        return _mm512_maskz_andnot_epi32(0xFFFF, a, b);
+    }
+    static inline vec xor_(vec a, vec b) { return _mm512_xor_si512(a, b); }
+    static inline vec add(vec a, vec b) { return _mm512_add_epi8(a, b); }
+    static inline vec sub(vec a, vec b) { return _mm512_sub_epi8(a, b); }
+    static inline vec adds(vec a, vec b) { return _mm512_adds_epu8(a, b); }
+    static inline vec subs(vec a, vec b) { return _mm512_subs_epu8(a, b); }
+    static inline vec eq(vec a, vec b) {
+        return _mm512_movm_epi8(_mm512_cmpeq_epi8_mask(a, b));
+    }
+
+    static inline bool any(vec v) { return _mm512_test_epi8_mask(v, v) != 0; }
+    static inline int first(vec v) {
+        const uint64_t m = _mm512_movepi8_mask(v);
+        return m ? __builtin_ctzll(m) : 64;
+    }
+    static inline uint64_t bits(vec v) { return _mm512_movepi8_mask(v); }
+    static inline int32_t last4(vec v) {
+        return _mm_extract_epi32(
+                _mm512_maskz_extracti32x4_epi32(0xF, v, 3), 3);
+    }
+    static inline uint64_t sum(vec v) {
+        const __m512i s8 = _mm512_sad_epu8(v, zero());
+        const __m256i s4 = _mm256_add_epi64(
+                _mm512_maskz_extracti64x4_epi64(0xF, s8, 0),
+                _mm512_maskz_extracti64x4_epi64(0xF, s8, 1));
+        const __m128i s2 = _mm_add_epi64(_mm256_castsi256_si128(s4),
+                _mm256_extracti128_si256(s4, 1));
+        return _mm_cvtsi128_si64(s2) + _mm_extract_epi64(s2, 1);
+    }
+};
+#endif
+
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+struct Neon {
+    typedef uint8x16_t vec;
+    enum { size = 16 };
+
+    static inline vec load(const unsigned char *p) { return vld1q_u8(p); }
+    static inline void store(unsigned char *p, vec v) { vst1q_u8(p, v); }
+    /* PRFM PLDL1STRM, streaming hint */
+    static inline void prefetch_nta(const unsigned char *p) {
+        __builtin_prefetch(p, 0, 0);
+    }
+    static inline vec table(const void *t) {
+        return vld1q_u8((const uint8_t *)t);
+    }
+    static inline vec dup(uint8_t v) { return vdupq_n_u8(v); }
+    static inline vec zero() { return vdupq_n_u8(0); }
+
+    /* tbl returns 0 for all indices >= 16, not only 7-th bit set */
+    static inline vec lookup(vec t, vec idx) { return vqtbl1q_u8(t, idx); }
+    static inline vec high_nibbles(vec v) { return vshrq_n_u8(v, 4); }
+    template <int N> static inline vec push(vec prev, vec cur) {
+        return vextq_u8(prev, cur, 16 - N);
+    }
+
+    static inline vec or_(vec a, vec b) { return vorrq_u8(a, b); }
+    static inline vec and_(vec a, vec b) { return vandq_u8(a, b); }
+    static inline vec andnot(vec a, vec b) { return vbicq_u8(b, a); }
+    static inline vec xor_(vec a, vec b) { return veorq_u8(a, b); }
+    static inline vec add(vec a, vec b) { return vaddq_u8(a, b); }
+    static inline vec sub(vec a, vec b) { return vsubq_u8(a, b); }
+    static inline vec adds(vec a, vec b) { return vqaddq_u8(a, b); }
+    static inline vec subs(vec a, vec b) { return vqsubq_u8(a, b); }
+    static inline vec eq(vec a, vec b) { return vceqq_u8(a, b); }
+
+    static inline bool any(vec v) { return vmaxvq_u8(v) != 0; }
+    /* Narrow to 4 bits per lane as there's no movemask */
+    static inline int first(vec v) {
+        const uint64_t m = vget_lane_u64(vreinterpret_u64_u8(
+                    vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+        return m ? __builtin_ctzll(m) / 4 : 16;
+    }
+    /* Weight lanes by bit position, add up each half */
+    static inline uint64_t bits(vec v) {
+        static const uint8_t w[16] = {
+            1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+        };
+        const uint8x16_t m = vandq_u8(v, vld1q_u8(w));
+        return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+    }
+    static inline int32_t last4(vec v) {
+        return vgetq_lane_u32(vreinterpretq_u32_u8(v), 3);
+    }
+    static inline uint64_t sum(vec v) { return vaddlvq_u8(v); }
+};
+
+#endif
+
+#endif
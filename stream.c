@@ -0,0 +1,160 @@
+/*
+ * Streaming validation, input arrives in chunks of any size
+ *
+ * Each chunk is validated by utf8_validate() up to its last complete char.
+ * The trailing incomplete char (at most 3 bytes) is carried to next chunk,
+ * and validated with the first bytes of next chunk by naive method.
+ * Scatter-gather buffers and ring buffers are validated as a stream of
+ * their segments.
+ */
+#include <limits.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "utf8range.h"
+
+int utf8_naive(const unsigned char *data, int len);
+
+/* Length of char from First Byte, 1 for ascii and invalid bytes */
+static int char_len(unsigned char byte1)
+{
+    if (byte1 >= 0xC0 && byte1 <= 0xDF)
+        return 2;
+    if (byte1 >= 0xE0 && byte1 <= 0xEF)
+        return 3;
+    if (byte1 >= 0xF0 && byte1 <= 0xF7)
+        return 4;
+    return 1;
+}
+
+void utf8_stream_init(struct utf8_stream *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+long long utf8_stream_update(struct utf8_stream *s,
+                             const unsigned char *data, int len)
+{
+    if (s->error)
+        return s->error;
+
+    /* Complete the char carried from last chunk */
+    if (s->carry_len) {
+        const int bytes = char_len(s->carry[0]);
+        const int need = bytes - s->carry_len;
+        unsigned char c[4];
+
+        if (len < need) {
+            memcpy(s->carry + s->carry_len, data, len);
+            s->carry_len += len;
+            return 0;
+        }
+
+        memcpy(c, s->carry, s->carry_len);
+        memcpy(c + s->carry_len, data, need);
+        if (utf8_naive(c, bytes))
+            return s->error = s->offset + 1;
+
+        s->offset += bytes;
+        s->carry_len = 0;
+        data += need;
+        len -= need;
+    }
+
+    /* Find incomplete char in last 3 bytes */
+    int cut = len;
+    for (int i = 1; i <= 3 && i <= len; ++i) {
+        const unsigned char b = data[len - i];
+
+        if ((b & 0xC0) != 0x80) {
+            if (char_len(b) > i)
+                cut = len - i;
+            break;
+        }
+    }
+
+    const int err = utf8_validate(data, cut);
+    if (err)
+        return s->error = s->offset + err;
+
+    s->offset += cut;
+    s->carry_len = len - cut;
+    memcpy(s->carry, data + cut, s->carry_len);
+
+    return 0;
+}
+
+long long utf8_stream_finish(struct utf8_stream *s)
+{
+    /* Truncated char at end of stream */
+    if (s->error == 0 && s->carry_len)
+        s->error = s->offset + 1;
+
+    return s->error;
+}
+
+/* Segments longer than INT_MAX are fed in pieces */
+static long long update(struct utf8_stream *s, const unsigned char *data,
+                        size_t len)
+{
+    while (len && s->error == 0) {
+        const int n = len < INT_MAX ? len : INT_MAX;
+
+        utf8_stream_update(s, data, n);
+        data += n;
+        len -= n;
+    }
+    return s->error;
+}
+
+long long utf8_validate_iov(const struct iovec *iov, int cnt)
+{
+    struct utf8_stream s;
+
+    utf8_stream_init(&s);
+    for (int i = 0; i < cnt; ++i) {
+        if (update(&s, iov[i].iov_base, iov[i].iov_len))
+            return s.error;
+    }
+
+    return utf8_stream_finish(&s);
+}
+
+/* Up to wrap point, then from base */
+long long utf8_validate_ring(const unsigned char *base, size_t capacity,
+                             size_t start, size_t len)
+{
+    struct utf8_stream s;
+    const size_t first = len < capacity - start ? len : capacity - start;
+
+    utf8_stream_init(&s);
+    if (update(&s, base + start, first) || update(&s, base, len - first))
+        return s.error;
+
+    return utf8_stream_finish(&s);
+}
+
+void utf8_ring_init(struct utf8_ring *r, size_t pos)
+{
+    utf8_stream_init(&r->stream);
+    r->pos = pos;
+}
+
+long long utf8_ring_update(struct utf8_ring *r, const unsigned char *base,
+                           size_t capacity, size_t head)
+{
+    if (head >= r->pos) {
+        update(&r->stream, base + r->pos, head - r->pos);
+    } else {
+        update(&r->stream, base + r->pos, capacity - r->pos);
+        update(&r->stream, base, head);
+    }
+    r->pos = head;
+
+    return r->stream.error;
+}
+
+long long utf8_ring_finish(struct utf8_ring *r)
+{
+    return utf8_stream_finish(&r->stream);
+}
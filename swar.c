@@ -0,0 +1,147 @@
+/*
+ * Range algorithm in 64 bit words (SWAR), for targets without SIMD
+ *
+ * Each step classifies 8 bytes with shifts and masks. A byte class is a
+ * mask of bit 7 of each byte, (w << (7 - n)) moves bit n of every byte to
+ * bit 7 of the same byte, bits crossing into the next byte are masked off.
+ *
+ * - Lead bytes C0..FF, E0..FF, F0..FF expect Continuation Bytes at the next
+ *   1, 2, 3 positions. Shifting their masks by 8, 16, 24 bits gives the
+ *   positions where Continuation Bytes must be, they must equal the mask of
+ *   80..BF bytes.
+ * - First Bytes C0, C1, F5..FF are always errors.
+ * - E0, ED, F0, F4 restrict the range of next byte, checked by masks of
+ *   these First Bytes shifted by 8 bits against bits 5, 4 of next byte.
+ *
+ * Masks shifted out of a word are packed in one carry word for the next.
+ * The first error index is found by naive method from the char before the
+ * word with errors, like SIMD kernels do.
+ */
+#include <stdint.h>
+#include <string.h>
+
+int utf8_naive(const unsigned char *data, int len);
+
+#define HIGH    0x8080808080808080ULL
+
+/*
+ * Carry bits, in lowest 3 bytes
+ * - bit 7 of byte 0..2: Continuation Byte expected
+ * - bit 6, 5, 4 of byte 0: previous byte is E0/F0, ED/F4, F0/F4
+ */
+#define NEED    0x808080ULL
+
+/* First byte in lowest bits on any endian */
+static inline uint64_t load64(const unsigned char *data)
+{
+    uint64_t w;
+
+    memcpy(&w, data, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+/* Check E0, ED, F0, F4 with next byte, and C0, C1, F5..FF */
+static inline uint64_t special(uint64_t w, uint64_t lead2, uint64_t lead3,
+                               uint64_t lead4, uint64_t c, uint64_t *carry)
+{
+    const uint64_t b5 = w << 2, b4 = w << 3, b3 = w << 4;
+    const uint64_t b2 = w << 5, b1 = w << 6, b0 = w << 7;
+
+    /* Next byte must be: A0..BF(E0), 90..BF(F0), 80..9F(ED), 80..8F(F4) */
+    const uint64_t e0f0 = lead3 & ~(b3 | b2 | b1 | b0);
+    const uint64_t edf4 = (lead3 & ~b4 & b3 & b2 & ~b1 & b0) |
+                          (lead4 & ~b3 & b2 & ~b1 & ~b0);
+    const uint64_t f0f4 = lead4 & ~b3 & ~b1 & ~b0;
+
+    const uint64_t a = e0f0 << 8 | (c << 1 & 0x80);
+    const uint64_t b = edf4 << 8 | (c << 2 & 0x80);
+    const uint64_t f = f0f4 << 8 | (c << 3 & 0x80);
+
+    uint64_t err = a & ~b5 & ~(f & b4);
+    err |= b & (b5 | (f & b4));
+    /* C0, C1 */
+    err |= lead2 & ~b5 & ~(b4 | b3 | b2 | b1);
+    /* F5..FF */
+    err |= lead4 & (b3 | (b2 & (b1 | b0)));
+
+    *carry |= (e0f0 >> 57 & 0x40) | (edf4 >> 58 & 0x20) | (f0f4 >> 59 & 0x10);
+    return err;
+}
+
+/* Validate word w continuing from *carry, return non zero on error */
+static inline uint64_t check(uint64_t w, uint64_t *carry)
+{
+    const uint64_t c = *carry;
+    const uint64_t lead2 = w & w << 1 & HIGH;           /* C0..FF */
+    const uint64_t lead3 = lead2 & w << 2;              /* E0..FF */
+    const uint64_t lead4 = lead3 & w << 3;              /* F0..FF */
+    const uint64_t cont = w & ~(w << 1) & HIGH;         /* 80..BF */
+    const uint64_t need = lead2 << 8 | lead3 << 16 | lead4 << 24 | (c & NEED);
+    uint64_t err = need ^ cont;
+
+    *carry = lead2 >> 56 | lead3 >> 48 | lead4 >> 40;
+
+    /* Rare First Bytes: C0, C1, E0, E1, ED, EF, F0..FF */
+    const uint64_t rare = lead4 |
+                          (lead2 & ~(w << 3 | w << 4 | w << 5 | w << 6)) |
+                          (lead3 & w << 4 & w << 5 & w << 7);
+    if (rare || (c & ~NEED))
+        err |= special(w, lead2, lead3, lead4, c, carry);
+
+    return err & HIGH;
+}
+
+/* Return 0 - success,  >0 - index(1 based) of first error char */
+int utf8_swar(const unsigned char *data, int len)
+{
+    const unsigned char *p = data, *end = data + len;
+    uint64_t carry = 0;
+    int err = 0;
+
+    if (len < 8)
+        return utf8_naive(data, len);
+
+    while (end - p >= 8) {
+        /* Skip ascii words, only a previous char may be incomplete */
+        if ((carry & NEED) == 0) {
+            while (end - p >= 16 &&
+                   ((load64(p) | load64(p + 8)) & HIGH) == 0)
+                p += 16;
+            if (end - p < 8)
+                break;
+        }
+
+        if (check(load64(p), &carry)) {
+            err = 1;
+            break;
+        }
+        p += 8;
+    }
+
+    if (!err && p < end) {
+        /* Last 8 bytes shifted to drop checked ones, zeros shifted in are
+         * ascii, so an incomplete last char fails */
+        err = check(load64(end - 8) >> (8 - (end - p)) * 8, &carry) != 0;
+    } else if (!err) {
+        err = (carry & NEED) != 0;
+    }
+
+    if (!err)
+        return 0;
+
+    /* Start from the First Byte of the char spanning into p */
+    int back = 0;
+    for (int i = 1; i <= 3 && p - i >= data && p[-i] >= 0x80; ++i) {
+        if (p[-i] >= 0xC0) {
+            back = i;
+            break;
+        }
+    }
+    p -= back;
+
+    err = utf8_naive(p, end - p);
+    return err ? (p - data) + err : 0;
+}
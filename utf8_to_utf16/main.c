@@ -155,6 +155,7 @@ static int test_manual(const struct ftab *ftab, unsigned short *buf16,
         {"\xF2\x90\x91\x7F", 4},
         {"\xF4\x90\x88\xAA", 4},
         {"\xF4\x00\xBF\xBF", 4},
+        {"\xF8\x88\x80\x80", 4},
         {"\x00\x00\x00\x00\x00\xC2\x80\x00\x00\x00\xE1\x80\x80\x00\x00\xC2" \
          "\xC2\x80\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
          32},
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 
 /*
  * UTF-8 to UTF-16
@@ -18,6 +20,15 @@
  * +-------------------------------------+-------------------+
  */
 
+/* All 8 bytes at p are ascii */
+static inline int ascii_word(const unsigned char *p)
+{
+    uint64_t w;
+
+    memcpy(&w, p, 8);
+    return (w & 0x8080808080808080ULL) == 0;
+}
+
 /*
  * Parameters:
  * - buf8, len8: input utf-8 string
@@ -50,7 +61,22 @@ int utf8_to16_naive(const unsigned char *buf8, size_t len8,
         b0 = buf8[0];
 
         if ((b0 & 0x80) == 0) {
+            /* Widen ascii run a word at a time */
+            while (len8 >= 8 && len16_left >= 16 && ascii_word(buf8)) {
+                for (int i = 0; i < 8; ++i)
+                    buf16[i] = buf8[i];
+                buf16 += 8;
+                buf8 += 8;
+                len8 -= 8;
+                err_pos += 8;
+                *len16 += 16;
+                len16_left -= 16;
+            }
+            if (len8 == 0 || len16_left < 2 || (buf8[0] & 0x80))
+                continue;
+
             /* 0aaaaaaa -> 00000000 0aaaaaaa */
+            b0 = buf8[0];
             *buf16++ = b0;
             ++buf8;
             --len8;
@@ -112,7 +138,7 @@ int utf8_to16_naive(const unsigned char *buf8, size_t len8,
                 u |= b2;
                 u <<= 6;
                 u |= (b3 & 0x3F);
-                if (u <= 0xFFFF || u > 0x10FFFF)
+                if (u <= 0xFFFF || u > 0x10FFFF || b0 >= 0xF8)
                     return err_pos;
                 u -= 0x10000;
                 *buf16++ = (((u >> 10) & 0x3FF) | 0xD800);
@@ -0,0 +1,303 @@
+/*
+ * Public API of libutf8range, dispatch to the best kernel of target ISA.
+ * Only symbols marked UTF8RANGE_API are exported from the shared library.
+ */
+#include <string.h>
+
+#include "utf8range.h"
+
+int utf8_swar(const unsigned char *data, int len);
+int utf8_range2(const unsigned char *data, int len);
+int utf8_lookup3(const unsigned char *data, int len);
+int utf8_naive_count(const unsigned char *data, int len, size_t *count);
+int utf8_range_count(const unsigned char *data, int len, size_t *count);
+int utf8_naive_index(const unsigned char *data, int len, int *index,
+                     size_t *count);
+int utf8_naive_index_offset(const unsigned char *data, int len,
+                            const int *index, size_t count, size_t k);
+int utf8_range_index(const unsigned char *data, int len, int *index,
+                     size_t *count);
+int utf8_range_index_offset(const unsigned char *data, int len,
+                            const int *index, size_t count, size_t k);
+int utf8_naive_skip_chars(const unsigned char *data, int len, size_t k);
+int utf8_range_skip_chars(const unsigned char *data, int len, size_t k);
+int utf8_json_naive(const unsigned char *data, int len, uint64_t *mask,
+                    size_t *escapes);
+int utf8_range_json(const unsigned char *data, int len, uint64_t *mask,
+                    size_t *escapes);
+int utf8_lines_naive(const unsigned char *data, int len, const char *delims,
+                     int *ends, int *errors, int max_lines);
+int utf8_range_lines(const unsigned char *data, int len, const char *delims,
+                     int *ends, int *errors, int max_lines);
+int utf8_range_cstr(const char *str, size_t *len);
+int utf8_policy_naive(const unsigned char *data, int len, unsigned int policy);
+int utf8_range_policy(const unsigned char *data, int len, unsigned int policy);
+int utf8_cesu8_naive(const unsigned char *data, int len);
+int utf8_mutf8_naive(const unsigned char *data, int len);
+int utf8_range_cesu8(const unsigned char *data, int len);
+int utf8_range_mutf8(const unsigned char *data, int len);
+int utf8_wtf8_naive(const unsigned char *data, int len);
+int utf8_range_wtf8(const unsigned char *data, int len);
+int utf8_mutf8_to_utf8_naive(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len);
+int utf8_range_mutf8_to_utf8(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len);
+#ifdef __AVX2__
+int utf8_lookup3_avx2(const unsigned char *data, int len);
+int utf8_range_count_avx2(const unsigned char *data, int len, size_t *count);
+int utf8_range_index_avx2(const unsigned char *data, int len, int *index,
+                          size_t *count);
+int utf8_range_index_offset_avx2(const unsigned char *data, int len,
+                                 const int *index, size_t count, size_t k);
+int utf8_range_skip_chars_avx2(const unsigned char *data, int len, size_t k);
+int utf8_range_json_avx2(const unsigned char *data, int len, uint64_t *mask,
+                         size_t *escapes);
+int utf8_range_lines_avx2(const unsigned char *data, int len,
+                          const char *delims, int *ends, int *errors,
+                          int max_lines);
+int utf8_range_cstr_avx2(const char *str, size_t *len);
+int utf8_range_policy_avx2(const unsigned char *data, int len,
+                           unsigned int policy);
+int utf8_range_cesu8_avx2(const unsigned char *data, int len);
+int utf8_range_mutf8_avx2(const unsigned char *data, int len);
+int utf8_range_wtf8_avx2(const unsigned char *data, int len);
+int utf8_range_mutf8_to_utf8_avx2(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len);
+#endif
+#ifdef __AVX512BW__
+int utf8_range_cstr_avx512(const char *str, size_t *len);
+#endif
+
+int utf8_to16_naive(const unsigned char *buf8, size_t len8,
+        unsigned short *buf16, size_t *len16);
+
+int utf8_validate(const unsigned char *data, int len)
+{
+#if defined(__AVX2__)
+    if (utf8_lookup3_avx2(data, len) == 0)
+        return 0;
+#elif defined(__x86_64__)
+    if (utf8_lookup3(data, len) == 0)
+        return 0;
+#elif defined(__aarch64__)
+    /* range.h over Neon traits, two vectors per iteration */
+    if (utf8_range2(data, len) == 0)
+        return 0;
+#endif
+
+    /* Slow path on error (or no SIMD): find first error char */
+    return utf8_swar(data, len);
+}
+
+int utf8_validate_count(const unsigned char *data, int len, size_t *count)
+{
+#if defined(__AVX2__)
+    if (utf8_range_count_avx2(data, len, count) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_count(data, len, count) == 0)
+        return 0;
+#endif
+
+    return utf8_naive_count(data, len, count);
+}
+
+int utf8_validate_index(const unsigned char *data, int len, int *index,
+                        size_t *count)
+{
+#if defined(__AVX2__)
+    if (utf8_range_index_avx2(data, len, index, count) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_index(data, len, index, count) == 0)
+        return 0;
+#endif
+
+    return utf8_naive_index(data, len, index, count);
+}
+
+int utf8_index_offset(const unsigned char *data, int len, const int *index,
+                      size_t count, size_t k)
+{
+#if defined(__AVX2__)
+    return utf8_range_index_offset_avx2(data, len, index, count, k);
+#elif defined(__x86_64__) || defined(__aarch64__)
+    return utf8_range_index_offset(data, len, index, count, k);
+#else
+    return utf8_naive_index_offset(data, len, index, count, k);
+#endif
+}
+
+int utf8_truncate(const unsigned char *data, int len, int max_bytes)
+{
+    if (max_bytes >= len)
+        return len;
+    if (max_bytes <= 0)
+        return 0;
+
+    /* Back to First Byte of the char cut by max_bytes */
+    int pos = max_bytes;
+    for (int i = 0; i < 3 && pos > 0 && (data[pos] & 0xC0) == 0x80; ++i)
+        --pos;
+
+    return pos;
+}
+
+int utf8_truncate_chars(const unsigned char *data, int len, size_t max_chars)
+{
+#if defined(__AVX2__)
+    const int pos = utf8_range_skip_chars_avx2(data, len, max_chars);
+#elif defined(__x86_64__) || defined(__aarch64__)
+    const int pos = utf8_range_skip_chars(data, len, max_chars);
+#else
+    const int pos = utf8_naive_skip_chars(data, len, max_chars);
+#endif
+
+    return pos < 0 ? len : pos;
+}
+
+void utf8_split(const unsigned char *data, int len, int n, int *ends)
+{
+    for (int i = 0; i < n; ++i)
+        ends[i] = utf8_truncate(data, len, (long long)len * (i + 1) / n);
+}
+
+int utf8_revalidate(const unsigned char *data, int len, int start, int end)
+{
+    /* Multi-byte char before start may be cut, recheck from First Byte */
+    int lo = start;
+    if (lo > 0) {
+        int pos = lo - 1;
+        for (int i = 0; i < 3 && pos > 0 && (data[pos] & 0xC0) == 0x80; ++i)
+            --pos;
+        if (data[pos] >= 0x80)
+            lo = pos;
+    }
+
+    /* Continuation Bytes after end may belong to a char in [start, end) */
+    int hi = end;
+    for (int i = 0; i < 3 && hi < len && (data[hi] & 0xC0) == 0x80; ++i)
+        ++hi;
+
+    const int err = utf8_validate(data + lo, hi - lo);
+    return err ? lo + err : 0;
+}
+
+int utf8_validate_json(const unsigned char *data, int len, uint64_t *mask,
+                       size_t *escapes)
+{
+#if defined(__AVX2__)
+    if (utf8_range_json_avx2(data, len, mask, escapes) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_json(data, len, mask, escapes) == 0)
+        return 0;
+#endif
+
+    return utf8_json_naive(data, len, mask, escapes);
+}
+
+int utf8_validate_lines(const unsigned char *data, int len,
+                        const char *delims, int *ends, int *errors,
+                        int max_lines)
+{
+#if defined(__AVX2__)
+    return utf8_range_lines_avx2(data, len, delims, ends, errors, max_lines);
+#elif defined(__x86_64__) || defined(__aarch64__)
+    return utf8_range_lines(data, len, delims, ends, errors, max_lines);
+#else
+    return utf8_lines_naive(data, len, delims, ends, errors, max_lines);
+#endif
+}
+
+int utf8_validate_cstr(const char *str, size_t *len)
+{
+#if defined(__AVX512BW__)
+    if (utf8_range_cstr_avx512(str, len) == 0)
+        return 0;
+#elif defined(__AVX2__)
+    if (utf8_range_cstr_avx2(str, len) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_cstr(str, len) == 0)
+        return 0;
+#else
+    *len = strlen(str);
+#endif
+
+    return utf8_swar((const unsigned char *)str, *len);
+}
+
+int utf8_validate_policy(const unsigned char *data, int len,
+        unsigned int policy)
+{
+#if defined(__AVX2__)
+    if (utf8_range_policy_avx2(data, len, policy) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_policy(data, len, policy) == 0)
+        return 0;
+#endif
+
+    return utf8_policy_naive(data, len, policy);
+}
+
+int utf8_validate_cesu8(const unsigned char *data, int len)
+{
+#if defined(__AVX2__)
+    if (utf8_range_cesu8_avx2(data, len) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_cesu8(data, len) == 0)
+        return 0;
+#endif
+
+    return utf8_cesu8_naive(data, len);
+}
+
+int utf8_validate_mutf8(const unsigned char *data, int len)
+{
+#if defined(__AVX2__)
+    if (utf8_range_mutf8_avx2(data, len) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_mutf8(data, len) == 0)
+        return 0;
+#endif
+
+    return utf8_mutf8_naive(data, len);
+}
+
+int utf8_validate_wtf8(const unsigned char *data, int len)
+{
+#if defined(__AVX2__)
+    if (utf8_range_wtf8_avx2(data, len) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_wtf8(data, len) == 0)
+        return 0;
+#endif
+
+    return utf8_wtf8_naive(data, len);
+}
+
+int utf8_from_mutf8(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len)
+{
+    /* Fails on ill-formed input or short buffer, naive tells exact error */
+#if defined(__AVX2__)
+    if (utf8_range_mutf8_to_utf8_avx2(src, len, dst, dst_len) == 0)
+        return 0;
+#elif defined(__x86_64__) || defined(__aarch64__)
+    if (utf8_range_mutf8_to_utf8(src, len, dst, dst_len) == 0)
+        return 0;
+#endif
+
+    return utf8_mutf8_to_utf8_naive(src, len, dst, dst_len);
+}
+
+int utf8_to_utf16(const unsigned char *buf8, size_t len8,
+        unsigned short *buf16, size_t *len16)
+{
+    return utf8_to16_naive(buf8, len8, buf16, len16);
+}
@@ -0,0 +1,296 @@
+#ifndef UTF8RANGE_H
+#define UTF8RANGE_H
+
+/*
+ * Fast UTF-8 validation (SSE4+AVX2+NEON)
+ * https://github.com/cyb70289/utf8
+ *
+ * Link with libutf8range.a or libutf8range.so. The best kernel is picked
+ * per target ISA at build time (-march): utf8_validate() runs Keiser-Lemire
+ * lookup3 on x86 (SSE4 or AVX2), Range on Arm (NEON), and SWAR without
+ * SIMD, which also locates errors. Other functions are fused into Range
+ * kernels.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define UTF8RANGE_API __attribute__((visibility("default")))
+#else
+#define UTF8RANGE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Validate UTF-8 string
+ * Returns:
+ *  -  0: success
+ *  - >0: index(1 based) of first error char
+ */
+UTF8RANGE_API int utf8_validate(const unsigned char *data, int len);
+
+/*
+ * Validate UTF-8 string and count chars (code points) in one pass
+ * Parameters:
+ * - data, len: input utf-8 string
+ * - *count: on exit - count of chars on success, or count of chars before
+ *           first error char on failure
+ * Returns: same as utf8_validate()
+ */
+UTF8RANGE_API int utf8_validate_count(const unsigned char *data, int len,
+        size_t *count);
+
+/*
+ * Sparse char index for random access, one byte offset per
+ * UTF8_INDEX_STRIDE chars, index[i] is byte offset of char i * STRIDE.
+ * Index of len bytes string has at most UTF8_INDEX_SIZE(len) entries.
+ */
+#define UTF8_INDEX_STRIDE       128
+#define UTF8_INDEX_SIZE(len)    \
+    (((len) + UTF8_INDEX_STRIDE - 1) / UTF8_INDEX_STRIDE)
+
+/*
+ * Validate UTF-8 string and build sparse char index in one pass
+ * Parameters:
+ * - data, len: input utf-8 string
+ * - index: buffer of UTF8_INDEX_SIZE(len) entries
+ * - *count: on exit - count of chars
+ * On failure, index and count cover chars before first error char.
+ * Returns: same as utf8_validate()
+ */
+UTF8RANGE_API int utf8_validate_index(const unsigned char *data, int len,
+        int *index, size_t *count);
+
+/*
+ * Byte offset of k-th char (0 based) of a string indexed by
+ * utf8_validate_index(), one index lookup plus a scan of at most
+ * UTF8_INDEX_STRIDE chars. Slice chars [a, b) is bytes [offset(a), offset(b))
+ * Returns:
+ *  - >=0: byte offset, len if k == count
+ *  -  -1: k > count
+ */
+UTF8RANGE_API int utf8_index_offset(const unsigned char *data, int len,
+        const int *index, size_t count, size_t k);
+
+/*
+ * Truncate well-formed UTF-8 string at char boundary
+ * Returns length of the longest prefix not exceeding max_bytes, which never
+ * ends in the middle of a char. Walks back at most 3 bytes, never before
+ * data, so the result is within [0, max_bytes] for ill-formed input too.
+ */
+UTF8RANGE_API int utf8_truncate(const unsigned char *data, int len,
+        int max_bytes);
+
+/*
+ * Truncate well-formed UTF-8 string to at most max_chars chars
+ * Returns length in bytes of first max_chars chars, len if there are less
+ */
+UTF8RANGE_API int utf8_truncate_chars(const unsigned char *data, int len,
+        size_t max_chars);
+
+/*
+ * Split well-formed UTF-8 string to n chunks of near equal size at char
+ * boundaries, e.g., for parallel workers. Chunk i is bytes
+ * [ends[i-1], ends[i]), chunk 0 starts from 0, ends[n-1] is len. Chunks may
+ * be empty for very short strings.
+ */
+UTF8RANGE_API void utf8_split(const unsigned char *data, int len, int n,
+        int *ends);
+
+/*
+ * Revalidate well-formed UTF-8 string after an edit, which inserted,
+ * replaced or removed (start == end) bytes, now at [start, end)
+ * Only [start, end) and chars split by the edit are validated, i.e., the
+ * char ending at start and at most 3 Continuation Bytes after end, so the
+ * cost doesn't depend on len. 0 <= start <= end <= len.
+ * Returns: same as utf8_validate(), index from data
+ */
+UTF8RANGE_API int utf8_revalidate(const unsigned char *data, int len,
+        int start, int end);
+
+/*
+ * Validate UTF-8 string and find bytes to escape in JSON string ('"', '\\'
+ * and 00..1F) in one pass
+ * Parameters:
+ * - data, len: input utf-8 string
+ * - mask: buffer of UTF8_JSON_MASK_SIZE(len) words, on exit - bit (i % 64)
+ *         of mask[i / 64] is set if byte i needs escape
+ * - *escapes: on exit - count of bytes to escape, 0 if string can be copied
+ *             as is
+ * On failure, mask and escapes cover bytes before first error char.
+ * Returns: same as utf8_validate()
+ */
+#define UTF8_JSON_MASK_SIZE(len)    (((len) + 63) / 64)
+
+UTF8RANGE_API int utf8_validate_json(const unsigned char *data, int len,
+        uint64_t *mask, size_t *escapes);
+
+/*
+ * Split string to lines and validate each line alone in one pass
+ * Parameters:
+ * - data, len: input string
+ * - delims: NUL terminated delimiter set, 1 to 8 ascii bytes, e.g., "\n"
+ * - ends: on exit - ends[i] is offset of delimiter of line i, or len for
+ *         the last line without delimiter
+ * - errors: on exit - errors[i] is 0 if line i is valid, or index(1 based)
+ *           of first error char from start of line i
+ * - max_lines: length of ends and errors
+ * Returns count of lines n. If n is max_lines, lines after ends[n-1] are not
+ * processed, continue from ends[n-1] + 1 if it is less than len.
+ */
+UTF8RANGE_API int utf8_validate_lines(const unsigned char *data, int len,
+        const char *delims, int *ends, int *errors, int max_lines);
+
+/*
+ * Streaming validation of input in chunks, e.g., file or network reads
+ * - utf8_stream_init(): reset state before first chunk
+ * - utf8_stream_update(): validate next chunk of any length, a char may
+ *   span chunks
+ * - utf8_stream_finish(): call after last chunk, reports truncated char
+ * Returns:
+ *  -  0: success so far
+ *  - >0: index(1 based) of first error char from start of stream, once an
+ *        error is found, following chunks are ignored
+ */
+struct utf8_stream {
+    long long offset;           /* Stream offset of first unchecked byte */
+    long long error;            /* First error, 0 if none */
+    unsigned char carry[4];     /* Incomplete char at end of last chunk */
+    int carry_len;
+};
+
+UTF8RANGE_API void utf8_stream_init(struct utf8_stream *s);
+UTF8RANGE_API long long utf8_stream_update(struct utf8_stream *s,
+        const unsigned char *data, int len);
+UTF8RANGE_API long long utf8_stream_finish(struct utf8_stream *s);
+
+/*
+ * Validate scatter-gather buffers as one string, e.g., from readv(), a char
+ * may span segments. Segments are validated in place, only an incomplete
+ * char at the end of a segment (1~3 bytes) is copied.
+ * Returns: 0 or index(1 based) of first error char in concatenated data
+ */
+struct iovec;
+UTF8RANGE_API long long utf8_validate_iov(const struct iovec *iov, int cnt);
+
+/*
+ * Ring buffer of capacity bytes at base, data wraps past the end
+ * - utf8_validate_ring(): validate len bytes from ring position start
+ * - utf8_ring_init(): start incremental validation at ring position pos
+ * - utf8_ring_update(): validate bytes up to producer position head, i.e.,
+ *   new bytes since last call, which must be less than capacity
+ * - utf8_ring_finish(): producer is done, reports truncated char
+ * Neither segment is copied, only an incomplete char before head or the
+ * wrap point is. Bytes up to head may be overwritten after update.
+ * Returns: same as utf8_stream_update() and utf8_stream_finish(), index is
+ * counted from first byte validated
+ */
+struct utf8_ring {
+    struct utf8_stream stream;
+    size_t pos;                 /* Ring position of first new byte */
+};
+
+UTF8RANGE_API long long utf8_validate_ring(const unsigned char *base,
+        size_t capacity, size_t start, size_t len);
+UTF8RANGE_API void utf8_ring_init(struct utf8_ring *r, size_t pos);
+UTF8RANGE_API long long utf8_ring_update(struct utf8_ring *r,
+        const unsigned char *base, size_t capacity, size_t head);
+UTF8RANGE_API long long utf8_ring_finish(struct utf8_ring *r);
+
+/*
+ * Validate NUL terminated UTF-8 string, no strlen() is required
+ * Finds NUL and validates in one pass. Reads aligned blocks of up to 64
+ * bytes covering the string, never crossing a page boundary after NUL.
+ * Parameters:
+ * - str: NUL terminated string
+ * - *len: on exit - length of string, same as strlen(str)
+ * Returns: same as utf8_validate()
+ */
+UTF8RANGE_API int utf8_validate_cstr(const char *str, size_t *len);
+
+/*
+ * Code point policy, rejected on top of ill-formed sequences
+ * - NUL:     U+0000
+ * - CONTROL: U+0000..U+001F except TAB, LF, CR, and U+007F (DEL)
+ * - C1:      U+0080..U+009F
+ * - NONCHAR: U+FDD0..U+FDEF, U+xFFFE, U+xFFFF of all planes
+ * - PRIVATE: U+E000..U+F8FF, U+F0000..U+10FFFF
+ */
+#define UTF8_POLICY_NUL         0x01
+#define UTF8_POLICY_CONTROL     0x02
+#define UTF8_POLICY_C1          0x04
+#define UTF8_POLICY_NONCHAR     0x08
+#define UTF8_POLICY_PRIVATE     0x10
+
+/*
+ * Validate UTF-8 string and reject code points per policy in one pass
+ * Parameters:
+ * - data, len: input utf-8 string
+ * - policy: bitwise OR of UTF8_POLICY_*, 0 is same as utf8_validate()
+ * Returns:
+ *  -  0: success
+ *  - >0: index(1 based) of first ill-formed or rejected char
+ */
+UTF8RANGE_API int utf8_validate_policy(const unsigned char *data, int len,
+        unsigned int policy);
+
+/*
+ * Validate CESU-8 or Java Modified UTF-8 (MUTF-8) string
+ * - CESU-8: supplementary characters are encoded as surrogate pairs (ED A0..AF
+ *   xx ED B0..BF xx), 4 bytes sequences are ill-formed
+ * - MUTF-8: CESU-8 with U+0000 encoded as C0 80, byte 00 is ill-formed
+ * Unpaired surrogates are ill-formed, a surrogate pair is one 6 bytes char.
+ * Returns: same as utf8_validate()
+ */
+UTF8RANGE_API int utf8_validate_cesu8(const unsigned char *data, int len);
+UTF8RANGE_API int utf8_validate_mutf8(const unsigned char *data, int len);
+
+/*
+ * Validate WTF-8 string, e.g., file names from UTF-16 of Windows
+ * Lone surrogates (ED A0..BF xx) are legal, but a high surrogate followed by
+ * a low surrogate is ill-formed, the pair must be one 4 bytes sequence.
+ * Returns: same as utf8_validate(), error index of an illegal surrogate pair
+ * points to the high surrogate
+ */
+UTF8RANGE_API int utf8_validate_wtf8(const unsigned char *data, int len);
+
+/*
+ * MUTF-8 to UTF-8, C0 80 -> 00, surrogate pair -> 4 bytes sequence
+ * Parameters:
+ * - src, len: input MUTF-8 string
+ * - dst: buffer to store UTF-8 string, output is never longer than input
+ * - *dst_len: on entry - output buffer length, SIMD path requires >= len
+ *             on exit  - length of valid converted UTF-8 string
+ * Returns:
+ *  -  0: success
+ *  - >0: error position of input MUTF-8 string
+ *  - -1: output buffer overflow
+ */
+UTF8RANGE_API int utf8_from_mutf8(const unsigned char *src, size_t len,
+        unsigned char *dst, size_t *dst_len);
+
+/*
+ * UTF-8 to UTF-16
+ * Parameters:
+ * - buf8, len8: input utf-8 string
+ * - buf16: buffer to store decoded utf-16 string
+ * - *len16: on entry - utf-16 buffer length in bytes
+ *           on exit  - length in bytes of valid decoded utf-16 string
+ * Returns:
+ *  -  0: success
+ *  - >0: error position of input utf-8 string
+ *  - -1: utf-16 buffer overflow
+ * LE/BE depends on host
+ */
+UTF8RANGE_API int utf8_to_utf16(const unsigned char *buf8, size_t len8,
+        unsigned short *buf16, size_t *len16);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
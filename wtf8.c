@@ -0,0 +1,60 @@
+#include <stdio.h>
+
+/*
+ * WTF-8 (Wobbly Transformation Format)
+ * https://simonsapin.github.io/wtf-8/
+ *
+ * Encodes potentially ill-formed UTF-16, e.g., Windows file names. Same as
+ * UTF-8 except that surrogates U+D800..U+DFFF (ED A0..BF 80..BF) are legal,
+ * as long as a high surrogate (ED A0..AF xx) is not followed by a low
+ * surrogate (ED B0..BF xx). Such pair must be encoded as one 4 bytes
+ * sequence.
+ */
+
+int utf8_naive(const unsigned char *data, int len);
+
+/*
+ * Validate char by char with utf8_naive, surrogates are checked here
+ * Return 0 - success, >0 - index(1 based) of first error char, which is the
+ * high surrogate of a paired surrogates
+ */
+int utf8_wtf8_naive(const unsigned char *data, int len)
+{
+    int err_pos = 1;
+    int high = 0;   /* Previous char is a high surrogate */
+
+    while (len) {
+        const unsigned char byte1 = data[0];
+        int bytes;
+
+        if (byte1 <= 0x7F)
+            bytes = 1;
+        else if (byte1 <= 0xDF)
+            bytes = 2;
+        else if (byte1 <= 0xEF)
+            bytes = 3;
+        else
+            bytes = 4;
+
+        if (bytes > len)
+            return err_pos;
+
+        if (byte1 == 0xED && data[1] >= 0xA0 && data[1] <= 0xBF &&
+                data[2] >= 0x80 && data[2] <= 0xBF) {
+            /* Surrogate */
+            if (high && data[1] >= 0xB0)
+                return err_pos - 3;
+            high = data[1] <= 0xAF;
+        } else {
+            if (utf8_naive(data, bytes))
+                return err_pos;
+            high = 0;
+        }
+
+        len -= bytes;
+        err_pos += bytes;
+        data += bytes;
+    }
+
+    return 0;
+}